@@ -0,0 +1,129 @@
+//
+//    File: anchor_solver.cpp
+//
+//    Licensed under the terms of the Lesser General Public License.
+//
+
+#include <stdio.h>
+#include <algorithm>
+
+#include "anchor_solver.h"
+
+AnchorSolver::AnchorSolver(Solver_Type type, int max_updates)
+{
+  this->max_updates = max_updates;
+  base = NormalSolver::create(type);
+  pattern_analyzed = 0;
+}
+
+AnchorSolver::~AnchorSolver()
+{
+  delete base;
+}
+
+void AnchorSolver::set_gram(const SpMatR *gram)
+{
+  // L^T L is symmetric: the transposed CSR copy is the CSC matrix
+  this->gram = gram->transpose().cast<double>();
+  this->gram.makeCompressed();
+
+  pattern_analyzed = 0;
+  base_anchors.clear();
+  update_anchors.clear();
+}
+
+int AnchorSolver::number_of_anchors(void) const
+{
+  return base_anchors.size() + update_anchors.size();
+}
+
+int AnchorSolver::factorize(const vector<int> &anchors)
+{
+  base_anchors = anchors;
+  update_anchors.clear();
+
+  return refactorize();
+}
+
+int AnchorSolver::refactorize(void)
+{
+  SpMatd A = gram;
+  vector<int>::size_type st;
+
+  // anchors only touch the diagonal, which L^T L already holds
+  for (st=0; st < base_anchors.size(); st++)
+    A.coeffRef(base_anchors[st], base_anchors[st]) += 1.0;
+  A.makeCompressed();
+
+  if (!pattern_analyzed)
+  {
+    base->analyze_pattern(&A);
+    pattern_analyzed = 1;
+  }
+  if (base->factorize(&A))
+  {
+    fprintf(stderr, "AnchorSolver: factorization failed\n");
+    return 1;
+  }
+
+  updates.resize(gram.rows(), 0);
+  capacitance.resize(0, 0);
+
+  return 0;
+}
+
+int AnchorSolver::add_anchor(int index)
+{
+  int k = update_anchors.size();
+  int i;
+
+  // too many updates: fold them into a fresh factorization
+  if (k >= max_updates)
+  {
+    base_anchors.insert(base_anchors.end(),
+			update_anchors.begin(), update_anchors.end());
+    base_anchors.push_back(index);
+    update_anchors.clear();
+    return refactorize();
+  }
+
+  MatrixXd e = MatrixXd::Zero(gram.rows(), 1), z;
+  e(index, 0) = 1.0;
+  base->solve(e, &z);
+  // the columns grow with the anchors, doubling so that few are copied
+  if (k >= updates.cols())
+    updates.conservativeResize(NoChange, min(max(2*k, 4), max_updates));
+  updates.col(k) = z;
+  update_anchors.push_back(index);
+
+  // grow the symmetric capacitance matrix by one row and column
+  capacitance.conservativeResize(k+1, k+1);
+  for (i=0; i < k; i++)
+    capacitance(i, k) = capacitance(k, i) = updates(update_anchors[i], k);
+  capacitance(k, k) = 1.0 + updates(index, k);
+  capacitance_ldlt.compute(capacitance);
+
+  return 0;
+}
+
+int AnchorSolver::solve(const MatrixXf &rhs, MatrixXf *result)
+{
+  int k = update_anchors.size();
+  int i;
+
+  MatrixXd y;
+
+  base->solve(rhs.cast<double>(), &y);
+
+  if (k > 0)
+  {
+    // x = y - Z C^-1 U^T y   with   y = M0^-1 b
+    MatrixXd w(k, rhs.cols());
+    for (i=0; i < k; i++)
+      w.row(i) = y.row(update_anchors[i]);
+    y -= updates.leftCols(k) * capacitance_ldlt.solve(w);
+  }
+  *result = y.cast<float>();
+
+  return 0;
+}
@@ -0,0 +1,60 @@
+//
+//    File: anchor_solver.h
+//
+//    Licensed under the terms of the Lesser General Public License.
+//
+
+#ifndef _ANCHOR_SOLVER_H
+#define _ANCHOR_SOLVER_H
+
+#include <vector>
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+
+#include "normal_solver.h"
+
+using namespace Eigen;
+using namespace std;
+
+typedef Eigen::SparseMatrix<float> SpMat;
+typedef Eigen::SparseMatrix<float, RowMajor> SpMatR;
+
+// Solves the anchored normal equations (L^T L + A^T A) x = b of the
+// Laplacian reconstruction. L^T L plus the anchors given to factorize()
+// is factored once; every anchor added later is a rank-one diagonal
+// update e_j e_j^T that is folded in with the Woodbury identity, so it
+// costs one extra back-substitution instead of a new factorization.
+// The update cancels large terms of M0^-1, so it works in double.
+class AnchorSolver
+{
+public:
+  AnchorSolver(Solver_Type type = LDLT_SOLVER, int max_updates = 64);
+  ~AnchorSolver();
+
+  void set_gram(const SpMatR *gram);
+  int factorize(const vector<int> &anchors);
+  int add_anchor(int index);
+  int solve(const MatrixXf &rhs, MatrixXf *result);
+
+  int number_of_anchors(void) const;
+
+private:
+  AnchorSolver(const AnchorSolver &s);
+  AnchorSolver& operator=(const AnchorSolver &s);
+  int refactorize(void);
+
+  SpMatd gram;                // L^T L
+  NormalSolver *base;         // factorization of L^T L + base anchors
+  int pattern_analyzed;
+
+  vector<int> base_anchors;   // anchors inside the factorization
+  vector<int> update_anchors; // anchors applied as Woodbury updates
+  int max_updates;
+
+  MatrixXd updates;           // M0^-1 U, one column per update anchor,
+                              // grown on demand up to max_updates
+  MatrixXd capacitance;       // I + U^T M0^-1 U
+  LDLT<MatrixXd> capacitance_ldlt;
+};
+
+#endif
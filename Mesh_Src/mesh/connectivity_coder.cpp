@@ -0,0 +1,662 @@
+//
+//    File: connectivity_coder.cpp
+//
+//    Licensed under the terms of the Lesser General Public License.
+//
+
+#include <algorithm>
+
+#include "connectivity_coder.h"
+#include "edge.h"
+#include "vertex.h"
+
+// operations of the cut-border machine
+#define CB_NEW 0
+#define CB_FORWARD 1
+#define CB_BACKWARD 2
+#define CB_SPLIT 3
+#define CB_UNION 4
+#define CB_CLOSE 5
+#define CB_BORDER 6
+#define CB_SYMBOLS 7
+
+// The cut-border: cyclic loops of nodes, one node per occurrence of a
+// vertex. The edge from a node to the next one is a border edge of the
+// coded part, "done" once it turned out to lie on the mesh border. The
+// loops form a stack; the top one is the active loop and the gate is
+// its current edge a b. Encoder and decoder share this class, so the
+// gate moves in the same way on both sides.
+class CutBorder
+{
+public:
+  CutBorder(void);
+
+  // new active loop a b c of a start triangle, returns the node of a;
+  // the nodes of b and c follow
+  int start(int a, int b, int c);
+  // gate node of the active loop, -1 when no loop is left
+  int gate(void) const;
+
+  int vertex(int node) const;
+  int next(int node) const;
+  int prev(int node) const;
+  int nodes(void) const;
+  int loops(void) const;
+  int in_active_loop(int node) const;
+  // number of loops between the loop of node and the active one, plus 1
+  int depth(int node) const;
+  int loop_gate(int depth) const;
+
+  // the triangle b a x across the gate; the first three return the
+  // node that starts the new edge x b, split and join the second node
+  // of x that starts the edge x b
+  int add_vertex(int x);
+  int forward(void);
+  int backward(void);
+  void close(void);
+  int split(int k);
+  int join(int k);
+  void border(void);
+
+private:
+  int new_node(int v, int loop);
+  void link(int a, int b);
+  void advance(void);
+
+  vector<int> node_vertex, node_next, node_prev, node_loop;
+  vector<char> node_done;
+  vector<int> gates, open, stack_pos;  // per loop
+  vector<int> stack;                   // loop numbers, the active last
+};
+
+CutBorder::CutBorder(void)
+{
+}
+
+int CutBorder::new_node(int v, int loop)
+{
+  node_vertex.push_back(v);
+  node_next.push_back(-1);
+  node_prev.push_back(-1);
+  node_loop.push_back(loop);
+  node_done.push_back(0);
+
+  return node_vertex.size() - 1;
+}
+
+void CutBorder::link(int a, int b)
+{
+  node_next[a] = b;
+  node_prev[b] = a;
+}
+
+int CutBorder::start(int a, int b, int c)
+{
+  int loop = gates.size();
+  int na = new_node(a, loop);
+  int nb = new_node(b, loop);
+  int nc = new_node(c, loop);
+
+  link(na, nb);
+  link(nb, nc);
+  link(nc, na);
+  gates.push_back(na);
+  open.push_back(3);
+  stack_pos.push_back(stack.size());
+  stack.push_back(loop);
+
+  return na;
+}
+
+int CutBorder::gate(void) const
+{
+  return stack.empty() ? -1 : gates[stack.back()];
+}
+
+int CutBorder::vertex(int node) const
+{
+  return node_vertex[node];
+}
+
+int CutBorder::next(int node) const
+{
+  return node_next[node];
+}
+
+int CutBorder::prev(int node) const
+{
+  return node_prev[node];
+}
+
+int CutBorder::nodes(void) const
+{
+  return node_vertex.size();
+}
+
+int CutBorder::loops(void) const
+{
+  return stack.size();
+}
+
+int CutBorder::in_active_loop(int node) const
+{
+  return node_loop[node] == stack.back();
+}
+
+int CutBorder::depth(int node) const
+{
+  return stack.size() - 1 - stack_pos[node_loop[node]];
+}
+
+int CutBorder::loop_gate(int depth) const
+{
+  return gates[stack[stack.size() - 1 - depth]];
+}
+
+// gate edge a b becomes a x, x b; work goes on at a x, around a
+int CutBorder::add_vertex(int x)
+{
+  int g = gate(), loop = stack.back();
+  int n = node_next[g];
+  int xn = new_node(x, loop);
+
+  link(g, xn);
+  link(xn, n);
+  open[loop]++;
+  advance();
+
+  return xn;
+}
+
+// a b x becomes a x
+int CutBorder::forward(void)
+{
+  int g = gate(), loop = stack.back();
+
+  link(g, node_next[node_next[g]]);
+  open[loop]--;
+  advance();
+
+  return g;
+}
+
+// x a b becomes x b
+int CutBorder::backward(void)
+{
+  int g = gate(), loop = stack.back();
+  int p = node_prev[g];
+
+  link(p, node_next[g]);
+  open[loop]--;
+  gates[loop] = p;
+  advance();
+
+  return p;
+}
+
+// the active loop a b x is filled by the triangle
+void CutBorder::close(void)
+{
+  open[stack.back()] = 0;
+  advance();
+}
+
+// x at node k of the active loop: a b .. x .. splits into b .. x and
+// a x ..; the loop b .. x goes on top
+int CutBorder::split(int k)
+{
+  int g = gate(), loop = stack.back(), part = gates.size();
+  int n = node_next[g], q = node_next[k];
+  int i, kk, count = 0;
+
+  for (i=n; i != k; i=node_next[i])
+  {
+    node_loop[i] = part;
+    if (!node_done[i])
+      count++;
+  }
+  node_loop[k] = part;
+
+  // the second node of x takes over the edge x q
+  kk = new_node(node_vertex[k], loop);
+  node_done[kk] = node_done[k];
+  link(kk, q);
+  link(k, n);
+  node_done[k] = 0;
+  link(g, kk);
+
+  open[loop] -= count;
+  gates.push_back(k);
+  open.push_back(count + 1);
+  stack_pos.push_back(stack.size());
+  stack.push_back(part);
+  advance();
+
+  return kk;
+}
+
+// x at node k of another loop: that loop is cut open at x and
+// inserted as a x .. x b into the active loop
+int CutBorder::join(int k)
+{
+  int g = gate(), loop = stack.back(), other = node_loop[k];
+  int n = node_next[g], p = node_prev[k];
+  int i, kk;
+
+  i = k;
+  do
+  {
+    node_loop[i] = loop;
+    i = node_next[i];
+  } while (i != k);
+
+  kk = new_node(node_vertex[k], loop);
+  link(p, kk);
+  link(kk, n);
+  link(g, k);
+  open[loop] += open[other] + 1;
+
+  stack.erase(stack.begin() + stack_pos[other]);
+  for (i=stack_pos[other]; i < (int) stack.size(); i++)
+    stack_pos[stack[i]] = i;
+  stack_pos[other] = -1;
+  advance();
+
+  return kk;
+}
+
+// the gate edge lies on the mesh border
+void CutBorder::border(void)
+{
+  int g = gate(), loop = stack.back();
+
+  node_done[g] = 1;
+  open[loop]--;
+  gates[loop] = node_next[g];
+  advance();
+}
+
+// moves the gate past done edges and drops finished loops
+void CutBorder::advance(void)
+{
+  int loop, g;
+
+  while (!stack.empty())
+  {
+    loop = stack.back();
+    if (open[loop] == 0)
+    {
+      stack_pos[loop] = -1;
+      stack.pop_back();
+      continue;
+    }
+    for (g=gates[loop]; node_done[g]; g=node_next[g])
+      ;
+    gates[loop] = g;
+    return;
+  }
+}
+
+// Mesh side of the encoder: half-edge h = 3t+j runs from corner j to
+// corner j+1 of triangle t
+class CutBorderEncoder
+{
+public:
+  CutBorderEncoder(const list<Triangle*> *triangles, int vertices);
+
+  int find_opposites(const vector<Triangle*> &tri);
+  int encode(vector<unsigned char> *out, vector<int> *order);
+
+private:
+  int find_node(int t, int j);
+  void set_node(int node, int h);
+
+  int t_nr, v_nr;
+  vector<int> corner, opposite;
+  vector<int> halfedge_node, node_halfedge;
+  vector<char> done;
+  CutBorder cut;
+};
+
+CutBorderEncoder::CutBorderEncoder(const list<Triangle*> *triangles,
+				   int vertices)
+{
+  list<Triangle*>::const_iterator it;
+  int t, j;
+
+  t_nr = triangles->size();
+  v_nr = vertices;
+  corner.resize(3*t_nr);
+  for (it=triangles->begin(), t=0; it != triangles->end(); it++, t++)
+    for (j=0; j < 3; j++)
+      corner[3*t+j] = (*it)->vertices[j]->name - 1;
+  opposite.assign(3*t_nr, -1);
+  halfedge_node.assign(3*t_nr, -1);
+  done.assign(t_nr, 0);
+}
+
+// opposite half-edges through Edge::triangles, -1 on the mesh border;
+// nonzero if the mesh is not an oriented manifold
+int CutBorderEncoder::find_opposites(const vector<Triangle*> &tri)
+{
+  vector<int> number;
+  Triangle *other;
+  Edge *e;
+  int t, j, k, u, w, o;
+  unsigned int max_name = 0;
+
+  for (t=0; t < t_nr; t++)
+    max_name = max(max_name, tri[t]->name);
+  number.assign(max_name + 1, -1);
+  for (t=0; t < t_nr; t++)
+    number[tri[t]->name] = t;
+
+  for (t=0; t < t_nr; t++)
+    for (j=0; j < 3; j++)
+    {
+      u = corner[3*t+j];
+      w = corner[3*t+(j+1)%3];
+      if (u < 0 || u >= v_nr || u == w)
+	return 1;
+
+      e = NULL;
+      for (k=0; k < 3; k++)
+	if (tri[t]->edges[k] != NULL &&
+	    ((tri[t]->edges[k]->vertices[0]->name - 1 == (unsigned) u &&
+	      tri[t]->edges[k]->vertices[1]->name - 1 == (unsigned) w) ||
+	     (tri[t]->edges[k]->vertices[0]->name - 1 == (unsigned) w &&
+	      tri[t]->edges[k]->vertices[1]->name - 1 == (unsigned) u)))
+	  e = tri[t]->edges[k];
+      if (e == NULL || e->triangles.size() > 2)
+	return 1;
+      if (e->triangles.size() < 2)
+	continue;
+
+      other = e->triangles.front() == tri[t] ? e->triangles.back()
+	: e->triangles.front();
+      if (other == tri[t] || other->name > max_name
+	  || number[other->name] < 0)
+	return 1;
+      o = number[other->name];
+      for (k=0; k < 3; k++)
+	if (corner[3*o+k] == w && corner[3*o+(k+1)%3] == u)
+	  break;
+      if (k == 3)
+	return 1;
+      opposite[3*t+j] = 3*o+k;
+    }
+
+  return 0;
+}
+
+void CutBorderEncoder::set_node(int node, int h)
+{
+  if (node >= (int) node_halfedge.size())
+    node_halfedge.resize(2*node + 16, -1);
+  node_halfedge[node] = h;
+  halfedge_node[h] = node;
+}
+
+// node of x = corner j+2 of the uncoded triangle t whose edge x b comes
+// after it on the border: turn around x through uncoded triangles until
+// a coded one shows a border edge; -1 for a non-manifold vertex
+int CutBorderEncoder::find_node(int t, int j)
+{
+  int h, o;
+
+  // over the edge x b: the coded edge b x ends at x
+  for (h=3*t+(j+2)%3; (o=opposite[h]) >= 0; h=3*(o/3)+(o%3+1)%3)
+  {
+    if (done[o/3])
+      return cut.next(halfedge_node[o]);
+    if (o/3 == t)
+      return -1;
+  }
+  // the other way over the edge a x: the coded edge x a starts at x
+  for (h=3*t+(j+1)%3; (o=opposite[h]) >= 0; h=3*(o/3)+(o%3+2)%3)
+  {
+    if (done[o/3])
+      return halfedge_node[o];
+    if (o/3 == t)
+      return -1;
+  }
+
+  return -1;
+}
+
+int CutBorderEncoder::encode(vector<unsigned char> *out, vector<int> *order)
+{
+  list<Triangle*>::const_iterator it;
+  vector<int> new_index(v_nr, -1);
+  RangeEncoder coder(out);
+  AdaptiveModel start_model(2), offsets(NUMBER_SYMBOLS);
+  AdaptiveModel depths(NUMBER_SYMBOLS), loop_offsets(NUMBER_SYMBOLS);
+  vector<AdaptiveModel> symbols(CB_SYMBOLS+1, AdaptiveModel(CB_SYMBOLS));
+  int context = CB_SYMBOLS, first = 0;
+  int t, j, g, n, k, kk, h, o, x, d, i, steps, old;
+
+  order->clear();
+  for (;;)
+  {
+    while (first < t_nr && done[first])
+      first++;
+    if (first == t_nr)
+      break;
+
+    // a new component starts with three new vertices
+    coder.encode(1, &start_model);
+    t = first;
+    for (j=0; j < 3; j++)
+    {
+      if (new_index[corner[3*t+j]] >= 0)
+	return -1;
+      new_index[corner[3*t+j]] = order->size();
+      order->push_back(corner[3*t+j]);
+    }
+    done[t] = 1;
+    n = cut.start(corner[3*t], corner[3*t+1], corner[3*t+2]);
+    for (j=0; j < 3; j++)
+      set_node(n + j, 3*t+j);
+
+    while ((g = cut.gate()) >= 0)
+    {
+      h = node_halfedge[g];
+      o = opposite[h];
+      if (o < 0)
+      {
+	coder.encode(CB_BORDER, &symbols[context]);
+	context = CB_BORDER;
+	cut.border();
+	continue;
+      }
+
+      // triangle b a x over the gate a b
+      t = o/3;
+      j = o%3;
+      if (done[t])
+	return -1;
+      x = corner[3*t+(j+2)%3];
+      n = cut.next(g);
+      if (new_index[x] < 0)
+      {
+	coder.encode(CB_NEW, &symbols[context]);
+	context = CB_NEW;
+	new_index[x] = order->size();
+	order->push_back(x);
+	k = cut.add_vertex(x);
+	set_node(g, 3*t+(j+1)%3);
+	set_node(k, 3*t+(j+2)%3);
+      }
+      else if ((k = find_node(t, j)) < 0)
+	return -1;
+      else if (k == cut.next(n) && k == cut.prev(g))
+      {
+	coder.encode(CB_CLOSE, &symbols[context]);
+	context = CB_CLOSE;
+	cut.close();
+      }
+      else if (k == cut.next(n))
+      {
+	coder.encode(CB_FORWARD, &symbols[context]);
+	context = CB_FORWARD;
+	set_node(cut.forward(), 3*t+(j+1)%3);
+      }
+      else if (k == cut.prev(g))
+      {
+	coder.encode(CB_BACKWARD, &symbols[context]);
+	context = CB_BACKWARD;
+	set_node(cut.backward(), 3*t+(j+2)%3);
+      }
+      else if (cut.in_active_loop(k))
+      {
+	for (i=n, steps=0; i != k; i=cut.next(i))
+	  steps++;
+	coder.encode(CB_SPLIT, &symbols[context]);
+	context = CB_SPLIT;
+	coder.encode_number(steps - 2, &offsets);
+	old = node_halfedge[k];
+	kk = cut.split(k);
+	set_node(g, 3*t+(j+1)%3);
+	set_node(k, 3*t+(j+2)%3);
+	set_node(kk, old);
+      }
+      else
+      {
+	d = cut.depth(k);
+	for (i=cut.loop_gate(d), steps=0; i != k; i=cut.next(i))
+	  steps++;
+	coder.encode(CB_UNION, &symbols[context]);
+	context = CB_UNION;
+	coder.encode_number(d - 1, &depths);
+	coder.encode_number(steps, &loop_offsets);
+	kk = cut.join(k);
+	set_node(g, 3*t+(j+1)%3);
+	set_node(kk, 3*t+(j+2)%3);
+      }
+      done[t] = 1;
+    }
+  }
+  coder.encode(0, &start_model);
+  coder.finish();
+
+  // vertices of no triangle keep their order at the end
+  for (i=0; i < v_nr; i++)
+    if (new_index[i] < 0)
+      order->push_back(i);
+
+  return 0;
+}
+
+int encode_connectivity(const list<Triangle*> *triangles, int vertices,
+			vector<unsigned char> *out, vector<int> *order)
+{
+  vector<Triangle*> tri(triangles->begin(), triangles->end());
+  CutBorderEncoder encoder(triangles, vertices);
+  int start = out->size();
+
+  if (encoder.find_opposites(tri) || encoder.encode(out, order))
+  {
+    out->resize(start);
+    order->clear();
+    return -1;
+  }
+
+  return 0;
+}
+
+int decode_connectivity(const unsigned char *data, int size, int vertices,
+			int triangles, vector<int> *indices)
+{
+  CutBorder cut;
+  RangeDecoder coder(data, size);
+  AdaptiveModel start_model(2), offsets(NUMBER_SYMBOLS);
+  AdaptiveModel depths(NUMBER_SYMBOLS), loop_offsets(NUMBER_SYMBOLS);
+  vector<AdaptiveModel> symbols(CB_SYMBOLS+1, AdaptiveModel(CB_SYMBOLS));
+  int context = CB_SYMBOLS, next_index = 0;
+  int g, n, k, a, b, x, i, symbol;
+  unsigned int raw, steps;
+
+  indices->clear();
+  while (coder.decode(&start_model) == 1)
+  {
+    if (next_index + 3 > vertices || (int) indices->size() >= 3*triangles)
+      return -1;
+    for (i=0; i < 3; i++)
+      indices->push_back(next_index + i);
+    cut.start(next_index, next_index + 1, next_index + 2);
+    next_index += 3;
+
+    while ((g = cut.gate()) >= 0)
+    {
+      if (coder.overrun())
+	return -1;
+      symbol = coder.decode(&symbols[context]);
+      context = symbol;
+      if (symbol == CB_BORDER)
+      {
+	cut.border();
+	continue;
+      }
+      if ((int) indices->size() >= 3*triangles)
+	return -1;
+
+      n = cut.next(g);
+      a = cut.vertex(g);
+      b = cut.vertex(n);
+      switch (symbol)
+      {
+      case CB_NEW:
+	if (next_index >= vertices)
+	  return -1;
+	x = next_index++;
+	cut.add_vertex(x);
+	break;
+      case CB_FORWARD:
+	x = cut.vertex(cut.next(n));
+	cut.forward();
+	break;
+      case CB_BACKWARD:
+	x = cut.vertex(cut.prev(g));
+	cut.backward();
+	break;
+      case CB_CLOSE:
+	if (cut.next(cut.next(n)) != g)
+	  return -1;
+	x = cut.vertex(cut.next(n));
+	cut.close();
+	break;
+      case CB_SPLIT:
+	// range-checked unsigned, a corrupt number must not wrap
+	raw = coder.decode_number(&offsets);
+	if (raw >= (unsigned) cut.nodes())
+	  return -1;
+	steps = raw + 2;
+	for (k=n, i=0; i < (int) steps && k != g; i++)
+	  k = cut.next(k);
+	if (k == g || k == cut.prev(g))
+	  return -1;
+	x = cut.vertex(k);
+	cut.split(k);
+	break;
+      default:
+	raw = coder.decode_number(&depths);
+	steps = coder.decode_number(&loop_offsets);
+	if (raw >= (unsigned) cut.loops() - 1 || steps >= (unsigned) cut.nodes())
+	  return -1;
+	for (k=cut.loop_gate(raw + 1), i=0; i < (int) steps; i++)
+	  k = cut.next(k);
+	x = cut.vertex(k);
+	cut.join(k);
+	break;
+      }
+      indices->push_back(b);
+      indices->push_back(a);
+      indices->push_back(x);
+    }
+  }
+
+  if (coder.overrun() || (int) indices->size() != 3*triangles)
+    return -1;
+
+  return coder.position();
+}
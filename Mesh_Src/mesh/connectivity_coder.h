@@ -0,0 +1,40 @@
+//
+//    File: connectivity_coder.h
+//
+//    Licensed under the terms of the Lesser General Public License.
+//
+
+#ifndef _CONNECTIVITY_CODER_H
+#define _CONNECTIVITY_CODER_H
+
+#include <list>
+#include <vector>
+
+#include "triangle.h"
+#include "range_coder.h"
+
+using namespace std;
+
+// Connectivity coder after the cut-border machine of Gumhold and
+// Strasser, a relative of Edgebreaker. The triangles are conquered one
+// at a time across the gate edge of a border that separates the coded
+// part from the rest; each step is one of seven symbols (new vertex,
+// connect forward or backward, split, union, close, mesh border) coded
+// adaptively with the previous symbol as context. Splits and unions
+// also store where on the border their third vertex lies. The decoder
+// runs the same border and numbers the vertices in order of appearance.
+//
+// The encoder walks the neighbours through Edge::triangles, so
+// create_edges() must have been run. It handles borders, several
+// components and handles; non-manifold edges or vertices, degenerate
+// triangles and inconsistent orientation make it return -1.
+
+// order gets the vertex names-1 in decoded order, unused vertices last
+int encode_connectivity(const list<Triangle*> *triangles, int vertices,
+			vector<unsigned char> *out, vector<int> *order);
+// three decoded vertex numbers per triangle; returns the bytes used or
+// -1 if the stream does not hold that many triangles and vertices
+int decode_connectivity(const unsigned char *data, int size, int vertices,
+			int triangles, vector<int> *indices);
+
+#endif
@@ -0,0 +1,242 @@
+//
+//    File: kd_tree.cpp
+//
+//    Licensed under the terms of the Lesser General Public License.
+//
+
+#include <math.h>
+#include <algorithm>
+
+#include "kd_tree.h"
+
+#define KD_LEAF 8
+
+// orders point numbers along one axis
+class Axis_Less
+{
+public:
+  Axis_Less(const float *points, int axis) : points(points), axis(axis) {}
+  bool operator()(int i, int j) const
+    { return points[3*i+axis] < points[3*j+axis]; }
+
+private:
+  const float *points;
+  int axis;
+};
+
+static float distance2(const float *p, const float *q)
+{
+  return (p[0]-q[0])*(p[0]-q[0]) + (p[1]-q[1])*(p[1]-q[1])
+    + (p[2]-q[2])*(p[2]-q[2]);
+}
+
+// keeps the k best (distance, list position) pairs in a max-heap
+static void offer(vector< pair<float, int> > *heap, int k,
+		  const pair<float, int> &c)
+{
+  if ((int) heap->size() < k)
+  {
+    heap->push_back(c);
+    push_heap(heap->begin(), heap->end());
+  }
+  else if (c < heap->front())
+  {
+    pop_heap(heap->begin(), heap->end());
+    heap->back() = c;
+    push_heap(heap->begin(), heap->end());
+  }
+}
+
+KdTree::KdTree(void)
+{
+}
+
+void KdTree::clear(void)
+{
+  items.clear();
+  index.clear();
+  coords.clear();
+  axis.clear();
+}
+
+int KdTree::size(void) const
+{
+  return items.size();
+}
+
+void KdTree::build(const list<Vertex*> *vertices)
+{
+  vector<float> points;
+  int i, k, n;
+
+  items.assign(vertices->begin(), vertices->end());
+  n = items.size();
+  points.resize(3*n);
+  for (i=0; i < n; i++)
+    for (k=0; k < 3; k++)
+      points[3*i+k] = items[i]->float_data()[k];
+
+  index.resize(n);
+  for (i=0; i < n; i++)
+    index[i] = i;
+  axis.assign(n, 0);
+  build(0, n, points);
+
+  // positions in tree order for the queries
+  coords.resize(3*n);
+  for (i=0; i < n; i++)
+    for (k=0; k < 3; k++)
+      coords[3*i+k] = points[3*index[i]+k];
+}
+
+void KdTree::build(int lo, int hi, const vector<float> &points)
+{
+  float low[3], high[3];
+  int i, k, m, a;
+
+  if (hi - lo <= KD_LEAF)
+    return;
+
+  // split the longest side of the bounding box at the median
+  for (k=0; k < 3; k++)
+    low[k] = high[k] = points[3*index[lo]+k];
+  for (i=lo+1; i < hi; i++)
+    for (k=0; k < 3; k++)
+    {
+      low[k] = min(low[k], points[3*index[i]+k]);
+      high[k] = max(high[k], points[3*index[i]+k]);
+    }
+  a = 0;
+  for (k=1; k < 3; k++)
+    if (high[k] - low[k] > high[a] - low[a])
+      a = k;
+
+  m = (lo + hi) / 2;
+  nth_element(index.begin() + lo, index.begin() + m, index.begin() + hi,
+	      Axis_Less(&points[0], a));
+  axis[m] = a;
+
+  build(lo, m, points);
+  build(m+1, hi, points);
+}
+
+void KdTree::search(int lo, int hi, const float *p, int k,
+		    vector< pair<float, int> > *heap) const
+{
+  int i, m;
+  float diff;
+
+  if (hi - lo <= KD_LEAF)
+  {
+    for (i=lo; i < hi; i++)
+      offer(heap, k, pair<float, int>(distance2(p, &coords[3*i]), index[i]));
+    return;
+  }
+
+  m = (lo + hi) / 2;
+  diff = p[axis[m]] - coords[3*m+axis[m]];
+  offer(heap, k, pair<float, int>(distance2(p, &coords[3*m]), index[m]));
+
+  // near side first, the far side only if the plane is close enough
+  if (diff < 0)
+    search(lo, m, p, k, heap);
+  else
+    search(m+1, hi, p, k, heap);
+  if ((int) heap->size() < k || diff * diff <= heap->front().first)
+  {
+    if (diff < 0)
+      search(m+1, hi, p, k, heap);
+    else
+      search(lo, m, p, k, heap);
+  }
+}
+
+void KdTree::search_radius(int lo, int hi, const float *p, float radius2,
+			   vector<Vertex*> *result) const
+{
+  int i, m;
+  float diff;
+
+  if (hi - lo <= KD_LEAF)
+  {
+    for (i=lo; i < hi; i++)
+      if (distance2(p, &coords[3*i]) <= radius2)
+	result->push_back(items[index[i]]);
+    return;
+  }
+
+  m = (lo + hi) / 2;
+  diff = p[axis[m]] - coords[3*m+axis[m]];
+  if (distance2(p, &coords[3*m]) <= radius2)
+    result->push_back(items[index[m]]);
+  if (diff <= 0 || diff * diff <= radius2)
+    search_radius(lo, m, p, radius2, result);
+  if (diff >= 0 || diff * diff <= radius2)
+    search_radius(m+1, hi, p, radius2, result);
+}
+
+Vertex* KdTree::nearest(const float *p, float *distance) const
+{
+  vector< pair<float, int> > heap;
+
+  if (items.empty())
+    return NULL;
+
+  heap.reserve(1);
+  search(0, items.size(), p, 1, &heap);
+  if (distance != NULL)
+    *distance = sqrt(heap[0].first);
+
+  return items[heap[0].second];
+}
+
+void KdTree::k_nearest(const float *p, int k, vector<Vertex*> *result) const
+{
+  vector< pair<float, int> > heap;
+  int i;
+
+  result->clear();
+  if (items.empty() || k <= 0)
+    return;
+
+  heap.reserve(k);
+  search(0, items.size(), p, k, &heap);
+  sort_heap(heap.begin(), heap.end());
+  for (i=0; i < (int) heap.size(); i++)
+    result->push_back(items[heap[i].second]);
+}
+
+void KdTree::within_radius(const float *p, float radius,
+			   vector<Vertex*> *result) const
+{
+  result->clear();
+  if (!items.empty() && radius >= 0)
+    search_radius(0, items.size(), p, radius * radius, result);
+}
+
+void KdTree::nearest(const MatrixXf &points, vector<Vertex*> *result) const
+{
+  int i, n = points.rows();
+
+  result->resize(n);
+#pragma omp parallel for
+  for (i=0; i < n; i++)
+  {
+    float p[3] = { points(i,0), points(i,1), points(i,2) };
+    (*result)[i] = nearest(p);
+  }
+}
+
+void KdTree::k_nearest(const MatrixXf &points, int k,
+		       vector< vector<Vertex*> > *result) const
+{
+  int i, n = points.rows();
+
+  result->resize(n);
+#pragma omp parallel for
+  for (i=0; i < n; i++)
+  {
+    float p[3] = { points(i,0), points(i,1), points(i,2) };
+    k_nearest(p, k, &(*result)[i]);
+  }
+}
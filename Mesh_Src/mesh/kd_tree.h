@@ -0,0 +1,61 @@
+//
+//    File: kd_tree.h
+//
+//    Licensed under the terms of the Lesser General Public License.
+//
+
+#ifndef _KD_TREE_H
+#define _KD_TREE_H
+
+#include <list>
+#include <vector>
+#include <utility>
+#include <Eigen/Dense>
+
+#include "vertex.h"
+
+using namespace Eigen;
+using namespace std;
+
+// Static k-d tree over vertex positions. The positions are copied into
+// one array in tree order: the node of a range is its median, split on
+// the axis of largest extent, and ranges of up to 8 points are leaves.
+// Equally distant vertices come in list order. Queries are const and
+// may run in parallel; the tree has to be built again when the
+// vertices move.
+class KdTree
+{
+public:
+  KdTree(void);
+
+  void build(const list<Vertex*> *vertices);
+  void clear(void);
+  int size(void) const;
+
+  // NULL for an empty tree; distance gets the Euclidean distance
+  Vertex* nearest(const float *p, float *distance = NULL) const;
+  // the k nearest vertices, closest first
+  void k_nearest(const float *p, int k, vector<Vertex*> *result) const;
+  // all vertices within radius, in no particular order
+  void within_radius(const float *p, float radius,
+		     vector<Vertex*> *result) const;
+
+  // one query per row of points (n x 3), answered in parallel
+  void nearest(const MatrixXf &points, vector<Vertex*> *result) const;
+  void k_nearest(const MatrixXf &points, int k,
+		 vector< vector<Vertex*> > *result) const;
+
+private:
+  void build(int lo, int hi, const vector<float> &points);
+  void search(int lo, int hi, const float *p, int k,
+	      vector< pair<float, int> > *heap) const;
+  void search_radius(int lo, int hi, const float *p, float radius2,
+		     vector<Vertex*> *result) const;
+
+  vector<Vertex*> items;       // the vertices in list order
+  vector<int> index;           // list position of tree point i
+  vector<float> coords;        // x y z of tree point i at 3i
+  vector<unsigned char> axis;  // split axis of the node at median i
+};
+
+#endif
@@ -11,6 +11,13 @@
 
 #include "mesh.h"
 #include<fstream>
+#include <limits.h>
+#include <new>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
 
 Mesh::Mesh()
 {
@@ -19,6 +26,23 @@ Mesh::Mesh()
 	model_centroid.set_zero();
 	model_scale = 1.0;
 	the_min = 100;
+	solver_type = LDLT_SOLVER;
+	normal_solver = NULL;
+	normal_pattern_analyzed = 0;
+	vertex_tree_valid = 0;
+	pcg_tolerance = 1e-6;
+	pcg_max_iterations = 10000;
+	schwarz_overlap = 2;
+	schwarz_solver = NULL;
+	greedy_batch = 1;
+	greedy_separation = 3;
+	greedy_band = 0.5;
+	greedy_tolerance = 0.1;
+	greedy_round = 1;
+	greedy_round_floor = 0;
+	original_surface_valid = 0;
+	distance_samples = 0;
+	quantization_bits = 0;
 	shapes = new vector<Shape*>;
 	triangles = new list<Triangle*>;
 	vertices = new list<Vertex*>;
@@ -34,6 +58,8 @@ Mesh::~Mesh()
 	delete triangles;
 	delete edges;
 	delete vertices;
+	delete normal_solver;
+	delete schwarz_solver;
 }
 
 void Mesh::clear(void)
@@ -43,14 +69,24 @@ void Mesh::clear(void)
 	list<Edge*>::iterator ie;
 	list<Vertex*>::iterator iv;
 
+	// pooled objects go with their pool, others are deleted one by one;
+	// triangles and edges before the vertices they detach from
 	for (is=shapes->begin(); is != shapes->end(); is++)
-		delete *is;
+		if (!shape_pool.owns(*is))
+			delete *is;
+	shape_pool.clear();
 	for (it=triangles->begin(); it != triangles->end(); it++)
-		delete *it;
+		if (!triangle_pool.owns(*it))
+			delete *it;
+	triangle_pool.clear();
 	for (ie=edges->begin(); ie != edges->end(); ie++)
-		delete *ie;
+		if (!edge_pool.owns(*ie))
+			delete *ie;
+	edge_pool.clear();
 	for (iv=vertices->begin(); iv != vertices->end(); iv++)
-		delete *iv;
+		if (!vertex_pool.owns(*iv))
+			delete *iv;
+	vertex_pool.clear();
 
 	shapes->clear();
 	triangles->clear();
@@ -58,6 +94,22 @@ void Mesh::clear(void)
 	vertices->clear();
 
 	edge_nr = ver_nr = tri_nr = 0;
+	triangle_names.clear();
+	edge_names.clear();
+	vertex_names.clear();
+	vertex_tree.clear();
+	vertex_tree_valid = 0;
+
+	// cached normal equations belong to the old connectivity
+	gram.resize(0, 0);
+	normal_pattern_analyzed = 0;
+	schwarz_parts.clear();
+	adjacency_offset.clear();
+	adjacency.clear();
+	vertex_index.clear();
+	original_laplacian.resize(0,3);
+	original_surface.clear();
+	original_surface_valid = 0;
 }
 
 int Mesh::number_of_vertices(void) const
@@ -79,18 +131,22 @@ void Mesh::add_triangle(Triangle *t)
 {
 	triangles->push_back(t);
 	t->name = ++tri_nr;
+	triangle_names.push_back(t);
 }
 
 void Mesh::add_edge(Edge *e)
 {
 	edges->push_back(e);
 	e->name = ++edge_nr;
+	edge_names.push_back(e);
 }
 
 void Mesh::add_vertex(Vertex *v)
 {
 	vertices->push_back(v);
 	v->name = ++ver_nr;
+	vertex_names.push_back(v);
+	vertex_tree_valid = 0;
 }
 
 void Mesh::remove(Vertex *v)
@@ -100,8 +156,11 @@ void Mesh::remove(Vertex *v)
 	vertices->remove(v);
 	for (is=shapes->begin(); is != shapes->end(); is++)
 		(*is)->vertices->remove(v);
+	if (get_vertex(v->name) == v)
+		vertex_names[v->name-1] = NULL;
+	vertex_tree_valid = 0;
 
-	delete v;
+	vertex_pool.destroy(v);
 }
 
 void Mesh::remove(Edge *e)
@@ -112,8 +171,10 @@ void Mesh::remove(Edge *e)
 	for (is=shapes->begin(); is != shapes->end(); is++)
 		if ((*is)->edges != NULL)
 			(*is)->edges->remove(e);
+	if (get_edge(e->name) == e)
+		edge_names[e->name-1] = NULL;
 
-	delete e;
+	edge_pool.destroy(e);
 }
 
 void Mesh::remove(Triangle *t)
@@ -123,8 +184,41 @@ void Mesh::remove(Triangle *t)
 	triangles->remove(t);
 	for (is=shapes->begin(); is != shapes->end(); is++)
 		(*is)->triangles->remove(t);
+	if (get_triangle(t->name) == t)
+		triangle_names[t->name-1] = NULL;
 
-	delete t;
+	triangle_pool.destroy(t);
+}
+
+Vertex* Mesh::new_vertex(float x, float y, float z)
+{
+	return new (vertex_pool.allocate()) Vertex(x, y, z);
+}
+
+Edge* Mesh::new_edge(Vertex *v1, Vertex *v2)
+{
+	return new (edge_pool.allocate()) Edge(v1, v2);
+}
+
+Triangle* Mesh::new_triangle(Vertex *v1, Vertex *v2, Vertex *v3)
+{
+	return new (triangle_pool.allocate()) Triangle(v1, v2, v3);
+}
+
+Shape* Mesh::new_shape(list<Triangle*> *tri, list<Vertex*> *ver,
+					   const char *text_name)
+{
+	return new (shape_pool.allocate()) Shape(tri, ver, text_name);
+}
+
+Shape* Mesh::new_shape(list<Edge*> *edg, list<Vertex*> *ver)
+{
+	return new (shape_pool.allocate()) Shape(edg, ver);
+}
+
+Shape* Mesh::new_shape(list<Vertex*> *ver)
+{
+	return new (shape_pool.allocate()) Shape(ver);
 }
 
 void Mesh::add_vertices(list<Vertex*> *new_vertices)
@@ -137,12 +231,12 @@ void Mesh::add_vertices(list<Vertex*> *new_vertices)
 
 	for (iv=new_vertices->begin(); iv != new_vertices->end(); iv++)
 	{
-		ver = new Vertex( (*iv)->x(), (*iv)->y(), (*iv)->z() );
+		ver = new_vertex( (*iv)->x(), (*iv)->y(), (*iv)->z() );
 		add_vertex(ver);
 		shape_vertices->push_back(ver);
 	}
 
-	shapes->push_back(new Shape(shape_vertices));
+	shapes->push_back(new_shape(shape_vertices));
 }
 
 void Mesh::add_edges(list<Edge*> *new_edges, int clear_map)
@@ -170,7 +264,7 @@ void Mesh::add_edges(list<Edge*> *new_edges, int clear_map)
 			if (iv == vertex_map.end())
 			{
 				// Create one new vertex
-				v[i] = new Vertex( ver->x(), ver->y(), ver->z() );
+				v[i] = new_vertex( ver->x(), ver->y(), ver->z() );
 				add_vertex(v[i]);
 				shape_vertices->push_back(v[i]);
 				// old vertex => new vertex
@@ -182,12 +276,12 @@ void Mesh::add_edges(list<Edge*> *new_edges, int clear_map)
 		}
 
 		// Create one new edge with the two vertices
-		edg = new Edge(v[0], v[1]);
+		edg = new_edge(v[0], v[1]);
 		add_edge(edg);
 		shape_edges->push_back(edg);
 	}
 
-	shapes->push_back(new Shape(shape_edges, shape_vertices));
+	shapes->push_back(new_shape(shape_edges, shape_vertices));
 
 	if (clear_map)
 		vertex_map.clear();
@@ -219,7 +313,7 @@ void Mesh::add_triangles(list<Triangle*> *new_triangles,
 			if (iv == vertex_map.end())
 			{
 				// Create one new vertex
-				v[i] = new Vertex( ver->x(), ver->y(), ver->z() );
+				v[i] = new_vertex( ver->x(), ver->y(), ver->z() );
 				add_vertex(v[i]);
 				shape_vertices->push_back(v[i]);
 				// old vertex => new vertex
@@ -231,7 +325,7 @@ void Mesh::add_triangles(list<Triangle*> *new_triangles,
 		}
 
 		// Create one new triangle with the three vertices
-		tri = new Triangle(v[0], v[1], v[2]);
+		tri = new_triangle(v[0], v[1], v[2]);
 		for (i=0; i < 3; i++)
 			tri->set_text_coordinates( i, (*it)->get_text_s(i),
 			(*it)->get_text_t(i) );
@@ -239,7 +333,7 @@ void Mesh::add_triangles(list<Triangle*> *new_triangles,
 		shape_triangles->push_back(tri);
 	}
 
-	shapes->push_back(new Shape(shape_triangles, 
+	shapes->push_back(new_shape(shape_triangles, 
 		shape_vertices, texture_name));
 
 	if (clear_map)
@@ -293,11 +387,6 @@ int Mesh::read(FILE *f, int (*update_progress)(int pos),
 
 void Mesh::write(FILE *f, const char *comment)
 {
-	int n;
-	list<Triangle*>::iterator it;
-	list<Vertex*>::iterator iv;
-	Vertex v;
-
 	fprintf(f, "ply\n");
 	fprintf(f, "format ascii 1.0\n");
 	fprintf(f, "comment %s\n", comment);
@@ -315,60 +404,185 @@ void Mesh::write(FILE *f, const char *comment)
 	fprintf(f, "property list uchar int vertex_indices\n");
 	fprintf(f, "end_header\n");
 
-	n=0;    // vertices
-	//for (iv=vertices->begin(); iv != vertices->end(); iv++)
-	//{
-	//	/*calc_original_coordinates(*iv, &v);
-	//	fprintf(f,"%f %f %f\n", v.x(), v.y(), v.z());*/
-	//	fprintf(f,"%f %f %f\n", (*iv)->x(), (*iv)->y(), (*iv)->z());
-	//	(*iv)->number=++n;
-	//}
+	write_ply_records(f);
+}
 
-	for (iv=vertices->begin(); iv != vertices->end(); iv++)
+// "%f" of a float: v*1e6 is exact in double for |v| < 1e12, so rounding
+// it half to even gives the same six decimals as printf
+static char* format_float(char *p, float value)
+{
+	double v = value, scaled, r;
+	unsigned __int64 n;
+	unsigned int fraction;
+	char digits[24];
+	int k, i;
+
+	if (!(v > -1e12 && v < 1e12))
+		return p + sprintf(p, "%f", value);
+	scaled = fabs(v * 1e6);
+	r = floor(scaled);
+	if (scaled - r > 0.5 || (scaled - r == 0.5 && fmod(r, 2.0) != 0))
+		r += 1;
+	n = (unsigned __int64) r;
+	if (v < 0 || (v == 0 && 1/v < 0))
+		*p++ = '-';
+	fraction = (unsigned int) (n % 1000000);
+	n /= 1000000;
+	k = 0;
+	do
+	{
+		digits[k++] = (char) ('0' + n % 10);
+		n /= 10;
+	} while (n);
+	while (k)
+		*p++ = digits[--k];
+	*p++ = '.';
+	for (i=5; i >= 0; i--)
+	{
+		p[i] = (char) ('0' + fraction % 10);
+		fraction /= 10;
+	}
+	return p + 6;
+}
+
+static char* format_int(char *p, int value)
+{
+	char digits[12];
+	unsigned int u = value < 0 ? 0u - (unsigned int) value : (unsigned int) value;
+	int k = 0;
+
+	if (value < 0)
+		*p++ = '-';
+	do
+	{
+		digits[k++] = (char) ('0' + u % 10);
+		u /= 10;
+	} while (u);
+	while (k)
+		*p++ = digits[--k];
+	return p;
+}
+
+void Mesh::write_ply_records(FILE *f)
+{
+	//vertex and face lines of an ASCII PLY, formatted by blocks of 65536
+	//records per thread and written with one fwrite per block
+	const int block = 65536;
+	const int vertex_record = 4*48 + 4*12;
+	const int face_record = 2 + 3*12;
+	vector<Vertex*> ver_array(vertices->begin(), vertices->end());
+	vector<Triangle*> tri_array(triangles->begin(), triangles->end());
+	int threads, first, t, n;
+#ifdef _OPENMP
+	threads = omp_get_max_threads();
+#else
+	threads = 1;
+#endif
+	vector< vector<char> > buffers(threads);
+	vector<int> length(threads);
+
+	for(n=0;n<(int)ver_array.size();n++)
+	{
+		ver_array[n]->number = n+1;
+	}
+
+	// vertices
+	for(first=0;first<(int)ver_array.size();first+=threads*block)
 	{
-		/*calc_original_coordinates(*iv, &v);
-		fprintf(f,"%f %f %f\n", v.x(), v.y(), v.z());*/
-		fprintf(f,"%f %f %f %d %d %d %d\n", (*iv)->math_newdata()->v[0], (*iv)->math_newdata()->v[1], (*iv)->math_newdata()->v[2],(*iv)->color[0],(*iv)->color[1],(*iv)->color[2],255);
-		(*iv)->number=++n;
+#pragma omp parallel for
+		for(t=0;t<threads;t++)
+		{
+			int a = first + t*block;
+			int b = min(a + block, (int)ver_array.size());
+			char *p, *start;
+			length[t] = 0;
+			if(a >= b)
+				continue;
+			buffers[t].resize(block*vertex_record);
+			p = start = &buffers[t][0];
+			for(int i=a;i<b;i++)
+			{
+				Vertex *v = ver_array[i];
+				p = format_float(p, v->math_newdata()->v[0]);
+				*p++ = ' ';
+				p = format_float(p, v->math_newdata()->v[1]);
+				*p++ = ' ';
+				p = format_float(p, v->math_newdata()->v[2]);
+				*p++ = ' ';
+				p = format_int(p, v->color[0]);
+				*p++ = ' ';
+				p = format_int(p, v->color[1]);
+				*p++ = ' ';
+				p = format_int(p, v->color[2]);
+				memcpy(p, " 255\n", 5);
+				p += 5;
+			}
+			length[t] = p - start;
+		}
+		for(t=0;t<threads;t++)
+		{
+			if(length[t])
+				fwrite(&buffers[t][0], 1, length[t], f);
+		}
 	}
 
 	// triangles
-	for (it=triangles->begin(); it != triangles->end(); it++)
-		fprintf(f,"3 %d %d %d\n", ((*it)->vertices[0]->number - 1),
-		((*it)->vertices[1]->number - 1), ((*it)->vertices[2]->number) - 1);
+	for(first=0;first<(int)tri_array.size();first+=threads*block)
+	{
+#pragma omp parallel for
+		for(t=0;t<threads;t++)
+		{
+			int a = first + t*block;
+			int b = min(a + block, (int)tri_array.size());
+			char *p, *start;
+			length[t] = 0;
+			if(a >= b)
+				continue;
+			buffers[t].resize(block*face_record);
+			p = start = &buffers[t][0];
+			for(int i=a;i<b;i++)
+			{
+				Triangle *tri = tri_array[i];
+				*p++ = '3';
+				for(int j=0;j<3;j++)
+				{
+					*p++ = ' ';
+					p = format_int(p, tri->vertices[j]->number - 1);
+				}
+				*p++ = '\n';
+			}
+			length[t] = p - start;
+		}
+		for(t=0;t<threads;t++)
+		{
+			if(length[t])
+				fwrite(&buffers[t][0], 1, length[t], f);
+		}
+	}
 }
 
 Vertex* Mesh::get_vertex(unsigned int name) const
 {
-	list<Vertex*>::iterator iv;
-
-	for (iv=vertices->begin(); iv != vertices->end(); iv++)
-		if ((*iv)->name == name)
-			return *iv;
+	if (name < 1 || name > vertex_names.size())
+		return NULL;
 
-	return NULL;
+	return vertex_names[name-1];
 }
 
 Edge* Mesh::get_edge(unsigned int name) const
 {
-	list<Edge*>::iterator ie;
-
-	for (ie=edges->begin(); ie != edges->end(); ie++)
-		if ((*ie)->name == name)
-			return *ie;
+	if (name < 1 || name > edge_names.size())
+		return NULL;
 
-	return NULL;
+	return edge_names[name-1];
 }
 
 Triangle* Mesh::get_triangle(unsigned int name) const
 {
-	list<Triangle*>::iterator it;
-
-	for (it=triangles->begin(); it != triangles->end(); it++)
-		if ((*it)->name == name)
-			return *it;
+	if (name < 1 || name > triangle_names.size())
+		return NULL;
 
-	return NULL;
+	return triangle_names[name-1];
 }
 
 int Mesh::type(FILE *f)
@@ -476,50 +690,80 @@ list<Edge*>* Mesh::get_edges(list<Edge*> *es) const
 	return edge_list;
 }
 
-Edge* Mesh::get_edge(map<pair<Vertex*,Vertex*>,Edge*> *edge_map, 
-					 Vertex *v1, Vertex *v2)
+void Mesh::create_edges(void)
 {
-	map<pair<Vertex*,Vertex*>,Edge*>::iterator ei;
+	// Every triangle side is keyed on its (min,max) vertex pair and the keys
+	// are sorted; the first side of each run creates the edge. Edges are
+	// made in side order, so names, orientations and vertex edge lists are
+	// those of a lookup triangle by triangle.
+	vector<Triangle*> tri(triangles->begin(), triangles->end());
+	int sides = 3 * tri.size();
+	int i, j, c, width, chunks;
+	static const int side_vertex[3][2] = { {0, 1}, {0, 2}, {1, 2} };
+
+	if (sides == 0)
+		return;
+
+	vector< pair<unsigned __int64, int> > key(sides);
+	vector<int> owner(sides);
+	vector<Edge*> edge_of(sides);
+
+#pragma omp parallel for private(j)
+	for (i=0; i < (int) tri.size(); i++)
+		for (j=0; j < 3; j++)
+		{
+			unsigned __int64 a = tri[i]->vertices[side_vertex[j][0]]->name;
+			unsigned __int64 b = tri[i]->vertices[side_vertex[j][1]]->name;
+			key[3*i+j] = make_pair(a < b ? (a << 32) | b : (b << 32) | a, 3*i+j);
+		}
 
-	// search in map (hash table)
-	// first try to get the edge
-	ei=edge_map->find( pair<Vertex*,Vertex*> (v1, v2) );
-	// second try to get the edge (reverse order)
-	if (ei == edge_map->end())
-		ei=edge_map->find( pair<Vertex*,Vertex*> (v2, v1) );
-	if (ei == edge_map->end())
+	// sort in chunks, then merge the chunks pairwise
+#ifdef _OPENMP
+	chunks = omp_get_max_threads();
+#else
+	chunks = 1;
+#endif
+	vector<int> bound(chunks+1);
+	for (c=0; c <= chunks; c++)
+		bound[c] = (int) ((__int64) sides * c / chunks);
+#pragma omp parallel for
+	for (c=0; c < chunks; c++)
+		sort(key.begin() + bound[c], key.begin() + bound[c+1]);
+	for (width=1; width < chunks; width*=2)
 	{
-		// create new edge
-		Edge *e = new Edge(v1, v2);
-		add_edge(e);
-
-		// new hash entry
-		(*edge_map)[ pair<Vertex*,Vertex*> (v1, v2) ] = e;
-		return e;
+#pragma omp parallel for
+		for (c=0; c < chunks; c+=2*width)
+			if (c + width < chunks)
+				inplace_merge(key.begin() + bound[c], key.begin() + bound[c+width],
+					key.begin() + bound[min(c+2*width, chunks)]);
 	}
-	else
-		return (*ei).second;
-}
 
-void Mesh::create_edges(void)
-{
-	list<Triangle*>::iterator it;
-	map<pair<Vertex*,Vertex*>,Edge*> edge_map;
-	Edge *e;
+	// each run of equal keys belongs to the side that comes first
+	c = 0;
+#pragma omp parallel for private(j) reduction(+:c)
+	for (i=0; i < sides; i++)
+		if (i == 0 || key[i].first != key[i-1].first)
+		{
+			for (j=i; j < sides && key[j].first == key[i].first; j++)
+				owner[key[j].second] = key[i].second;
+			c++;
+		}
+	edge_pool.reserve(c);
 
-	for (it=triangles->begin(); it != triangles->end(); it++)
+	for (i=0; i < sides; i++)
 	{
-		// edge 1
-		e = get_edge(&edge_map, (*it)->vertices[0], (*it)->vertices[1]);
-		(*it)->edges[0]=e;   e->addTriangle(*it);
-
-		// edge 2
-		e = get_edge(&edge_map, (*it)->vertices[0], (*it)->vertices[2]);
-		(*it)->edges[1]=e;   e->addTriangle(*it);
-
-		// edge 3
-		e = get_edge(&edge_map, (*it)->vertices[1], (*it)->vertices[2]);
-		(*it)->edges[2]=e;   e->addTriangle(*it);
+		Triangle *t = tri[i/3];
+		Edge *e;
+		if (owner[i] == i)
+		{
+			e = new_edge(t->vertices[side_vertex[i%3][0]],
+				t->vertices[side_vertex[i%3][1]]);
+			add_edge(e);
+		}
+		else
+			e = edge_of[owner[i]];
+		edge_of[i] = e;
+		t->edges[i%3]=e;   e->addTriangle(t);
 	}
 }
 
@@ -552,6 +796,7 @@ void Mesh::mymove_to_centre()
 	c.negation();
 	for (iv=vertices->begin(); iv != vertices->end(); iv++)
 		(*iv)->newdata.add(&c);
+	gather_positions();
 }
 
 MathVector Mesh::get_centroid(void) const
@@ -575,8 +820,12 @@ void Mesh::move(const MathVector *v)
 	// Move vertices and triangle centroids
 	for (iv=vertices->begin(); iv != vertices->end(); iv++)
 		(*iv)->move(v);
+	vertex_tree_valid = 0;
 	for (it=triangles->begin(); it != triangles->end(); it++)
 		(*it)->moveCentroid(v);
+	// the position copies and what depends on them follow the vertices
+	if (positions.rows() != 0)
+		gather_positions();
 }
 
 void Mesh::scale_into_normal_sphere(void)
@@ -608,12 +857,15 @@ void Mesh::scale(float scale)
 	// Scaling vertices
 	for (iv=vertices->begin(); iv != vertices->end(); iv++)
 		(*iv)->scale(scale);
+	vertex_tree_valid = 0;
 	// Recalculate triangle centroid, size, perimeter and so on
 	for (it=triangles->begin(); it != triangles->end(); it++)
 		(*it)->calc_properties();
 	// Recalculate edge centroid, length and so on
 	for (ie=edges->begin(); ie != edges->end(); ie++)
 		(*ie)->calc_properties();
+	if (positions.rows() != 0)
+		gather_positions();
 }
 
 void Mesh::calc_original_coordinates(const Vertex *v, Vertex *org) const
@@ -669,69 +921,426 @@ void Mesh::negate_surface_normals(void)
 		(*it)->negate_normal();
 }
 
-void Mesh::remove_double_points(void)
+// hash of grid cell (x,y,z) or of an exact position (+0 == -0)
+static unsigned __int64 cell_key(__int64 x, __int64 y, __int64 z)
 {
-	// the MathVector represents the x, y and z coordinates of the vertex
-	map<MathVector, Vertex*> vertex_map;
-	map<MathVector, Vertex*>::iterator i_map;
-	list<Vertex*>::iterator i_list;
-	list<Triangle*>::iterator it;
-	list<Triangle*> *ver_triangles;
-	list<Edge*>::iterator ie;
-	list<Edge*> *ver_edges;
+	return (((unsigned __int64) x * 0x9e3779b97f4a7c15ULL) ^
+		((unsigned __int64) y * 0xc2b2ae3d27d4eb4fULL) ^
+		((unsigned __int64) z * 0x165667b19e3779f9ULL));
+}
+
+static unsigned __int64 position_key(const float *p)
+{
+	unsigned int bits[3];
+	float c;
+
+	for (int k=0; k < 3; k++)
+	{
+		c = p[k] == 0 ? 0.0f : p[k];
+		memcpy(&bits[k], &c, sizeof(c));
+	}
+
+	return cell_key(bits[0], bits[1], bits[2]);
+}
+
+// first vertex before i within tolerance (equal if tolerance is 0) in
+// the spatial hash; with rep only representatives count. i if none.
+static int first_within(const vector<Vertex*> &ver, const vector<int> &start,
+						const vector<int> &member, int bits, float tolerance,
+						int i, int own_bucket, const int *rep)
+{
+	const float *p = ver[i]->float_data();
+	float h = 2 * tolerance;
+	__int64 lo[3], hi[3], x, y, z;
+	int b, j, k, best = i;
+
+	for (k=0; k < 3; k++)
+	{
+		lo[k] = tolerance > 0 ? (__int64) floor((p[k] - tolerance) / h) : 0;
+		hi[k] = tolerance > 0 ? (__int64) floor((p[k] + tolerance) / h) : 0;
+	}
+	for (x=lo[0]; x <= hi[0]; x++)
+		for (y=lo[1]; y <= hi[1]; y++)
+			for (z=lo[2]; z <= hi[2]; z++)
+			{
+				b = tolerance > 0 ?
+					(int) (cell_key(x, y, z) >> (64 - bits)) : own_bucket;
+				// members come in vertex order
+				for (j=start[b]; j < start[b+1] && member[j] < best; j++)
+				{
+					const float *q = ver[member[j]]->float_data();
+					float d = 0;
+					if (rep != NULL && rep[member[j]] != member[j])
+						continue;
+					for (k=0; k < 3; k++)
+						d += (p[k] - q[k]) * (p[k] - q[k]);
+					if (tolerance > 0 ? d <= tolerance * tolerance :
+						p[0] == q[0] && p[1] == q[1] && p[2] == q[2])
+						best = member[j];
+				}
+			}
+
+	return best;
+}
+
+// erases the elements whose name is marked
+template <class T> static void erase_marked(list<T*> *l,
+											const vector<char> &marked)
+{
+	typename list<T*>::iterator i;
+
+	for (i=l->begin(); i != l->end();)
+		if (marked[(*i)->name-1])
+			i=l->erase(i);
+		else
+			i++;
+}
+
+void Mesh::remove_double_points(float tolerance)
+{
+	// Vertices go into a spatial hash grid of cell size 2*tolerance (or
+	// are hashed by exact position if tolerance is 0), so the ball around
+	// a vertex touches at most 8 cells. Every vertex is welded to the
+	// first earlier representative within tolerance, so nothing moves
+	// further than that. Triangles, edges and shapes are then remapped in
+	// one sweep each, and triangles and edges that collapse are removed.
+	vector<Vertex*> ver(vertices->begin(), vertices->end());
+	vector<Triangle*> tri(triangles->begin(), triangles->end());
+	vector<Edge*> edg(edges->begin(), edges->end());
+	int n = ver.size();
+	int range = tolerance > 0 ? 1 : 0;
+	float h = 2 * tolerance;
+	int i, j, k, welded, bits;
+	list<Vertex*>::iterator iv;
+	vector<Shape*>::iterator is;
 
-	for (i_list=vertices->begin(); i_list != vertices->end();)
+	if (n == 0)
+		return;
+	for (bits=1; (1 << bits) < 2 * n; bits++);
+
+	// bucket b holds member[start[b] .. start[b+1]-1], by vertex order
+	vector<int> bucket(n), start((1 << bits) + 1, 0), member(n), rep(n);
+#pragma omp parallel for
+	for (i=0; i < n; i++)
 	{
-		// Check if we have the vertex already
-		i_map=vertex_map.find( *(*i_list)->math_data() );
-		if (i_map == vertex_map.end())
+		const float *p = ver[i]->float_data();
+		ver[i]->number = i;
+		bucket[i] = (int) ((range ? cell_key((__int64) floor(p[0] / h),
+			(__int64) floor(p[1] / h), (__int64) floor(p[2] / h)) :
+			position_key(p)) >> (64 - bits));
+	}
+	for (i=0; i < n; i++)
+		start[bucket[i]+1]++;
+	for (i=0; i < (1 << bits); i++)
+		start[i+1] += start[i];
+	vector<int> fill_pos(start.begin(), start.end()-1);
+	for (i=0; i < n; i++)
+		member[fill_pos[bucket[i]]++] = i;
+
+	// first vertex within tolerance, then the first representative
+	// within tolerance for the few whose match was welded itself
+#pragma omp parallel for
+	for (i=0; i < n; i++)
+		rep[i] = first_within(ver, start, member, bits, tolerance, i,
+							  bucket[i], NULL);
+	welded = 0;
+	for (i=0; i < n; i++)
+		if (rep[i] != i)
 		{
-			// Create a new entry
-			vertex_map[ *(*i_list)->math_data() ] = *i_list;
-			i_list++;
+			if (rep[rep[i]] != rep[i])
+				rep[i] = first_within(ver, start, member, bits, tolerance, i,
+									  bucket[i], &rep[0]);
+			welded += rep[i] != i;
 		}
-		else
+	if (welded == 0)
+		return;
+
+	// remap in parallel, remember the corners that moved; the geometry
+	// only changes with a tolerance
+	vector<char> tri_moved(tri.size()), edg_moved(edg.size());
+	vector<char> tri_dropped(tri_nr), edg_dropped(edge_nr), ver_dropped(ver_nr);
+#pragma omp parallel for private(j)
+	for (i=0; i < (int) tri.size(); i++)
+	{
+		Vertex **v = tri[i]->vertices;
+		for (j=0; j < 3; j++)
+			if (rep[v[j]->number] != (int) v[j]->number)
+			{
+				v[j] = ver[rep[v[j]->number]];
+				tri_moved[i] |= 1 << j;
+			}
+		if (v[0] == v[1] || v[0] == v[2] || v[1] == v[2])
+			tri_dropped[tri[i]->name-1] = 1;
+		else if (range && tri_moved[i])
+			tri[i]->calc_properties();
+	}
+#pragma omp parallel for private(j)
+	for (i=0; i < (int) edg.size(); i++)
+	{
+		Vertex **v = edg[i]->vertices;
+		for (j=0; j < 2; j++)
+			if (rep[v[j]->number] != (int) v[j]->number)
+			{
+				v[j] = ver[rep[v[j]->number]];
+				edg_moved[i] |= 1 << j;
+			}
+		if (v[0] == v[1])
+			edg_dropped[edg[i]->name-1] = 1;
+		else if (range && edg_moved[i])
+			edg[i]->calc_properties();
+	}
+	for (i=0; i < n; i++)
+		ver_dropped[ver[i]->name-1] = rep[i] != i;
+
+	// a moved corner joins the lists of its new vertex, so the counts
+	// stay right when a collapsed triangle or edge detaches itself
+	for (i=0; i < (int) tri.size(); i++)
+		for (j=0; j < 3; j++)
+			if (tri_moved[i] & (1 << j))
+				tri[i]->vertices[j]->addTriangle(tri[i]);
+	for (i=0; i < (int) edg.size(); i++)
+		for (j=0; j < 2; j++)
+			if (edg_moved[i] & (1 << j))
+				edg[i]->vertices[j]->addEdge(edg[i]);
+
+	// shapes keep one entry per vertex
+	vector<char> in_shape(n);
+	for (is=shapes->begin(); is != shapes->end(); is++)
+	{
+		if ((*is)->triangles != NULL)
+			erase_marked((*is)->triangles, tri_dropped);
+		if ((*is)->edges != NULL)
+			erase_marked((*is)->edges, edg_dropped);
+		if ((*is)->vertices == NULL)
+			continue;
+		fill(in_shape.begin(), in_shape.end(), 0);
+		for (iv=(*is)->vertices->begin(); iv != (*is)->vertices->end(); iv++)
+			in_shape[(*iv)->number] = 1;
+		for (iv=(*is)->vertices->begin(); iv != (*is)->vertices->end();)
 		{
-			// change all references to the vertex
-			ver_triangles=(*i_list)->get_triangles();
-			for (it=ver_triangles->begin(); it != ver_triangles->end(); it++)
-				(*it)->change_vertex(*i_list, (*i_map).second);
-			ver_edges=(*i_list)->get_edges();
-			for (ie=ver_edges->begin(); ie != ver_edges->end(); ie++)
-				(*ie)->change_vertex(*i_list, (*i_map).second);
+			k = rep[(*iv)->number];
+			if (k == (int) (*iv)->number)
+				iv++;
+			else if (in_shape[k])
+				iv=(*is)->vertices->erase(iv);
+			else
+			{
+				*iv = ver[k];
+				in_shape[k] = 1;
+				iv++;
+			}
+		}
+	}
 
-			// remove from shapes
-			for (int i=0; i < number_of_shapes(); i++)
-				get_shape(i)->change_vertex(*i_list, (*i_map).second);
+	erase_marked(triangles, tri_dropped);
+	erase_marked(edges, edg_dropped);
+	erase_marked(vertices, ver_dropped);
 
-			// delete vertex and remove from list
-			delete *i_list;
-			i_list=vertices->erase(i_list);
+	// triangles first, they detach from edges and vertices
+	for (i=0; i < (int) tri.size(); i++)
+		if (tri_dropped[tri[i]->name-1])
+		{
+			triangle_names[tri[i]->name-1] = NULL;
+			triangle_pool.destroy(tri[i]);
+		}
+	for (i=0; i < (int) edg.size(); i++)
+		if (edg_dropped[edg[i]->name-1])
+		{
+			edge_names[edg[i]->name-1] = NULL;
+			edge_pool.destroy(edg[i]);
 		}
+	for (i=0; i < n; i++)
+		if (rep[i] != i)
+			vertex_pool.destroy(ver[i]);
+
+	// number the remaining vertices, triangles and edges densely again
+	ver_nr=0;
+	vertex_names.clear();
+	for (iv=vertices->begin(); iv != vertices->end(); iv++)
+	{
+		(*iv)->name = ++ver_nr;
+		vertex_names.push_back(*iv);
+	}
+	tri_nr=0;
+	triangle_names.clear();
+	for (list<Triangle*>::iterator it=triangles->begin(); it != triangles->end(); it++)
+	{
+		(*it)->name = ++tri_nr;
+		triangle_names.push_back(*it);
+	}
+	edge_nr=0;
+	edge_names.clear();
+	for (list<Edge*>::iterator ie=edges->begin(); ie != edges->end(); ie++)
+	{
+		(*ie)->name = ++edge_nr;
+		edge_names.push_back(*ie);
 	}
+	vertex_tree_valid = 0;
+
+	// cached normal equations belong to the old connectivity
+	gram.resize(0, 0);
+	normal_pattern_analyzed = 0;
+	schwarz_parts.clear();
+	adjacency_offset.clear();
+	adjacency.clear();
+	vertex_index.clear();
+}
 
-	ver_nr=vertices->size();
+static unsigned int lowest_name(const Triangle *t)
+{
+	return min(t->vertices[0]->name, min(t->vertices[1]->name, t->vertices[2]->name));
 }
 
-Vertex* Mesh::find_closed_point(const Vertex *v) const
+static unsigned int lowest_name(const Edge *e)
+{
+	return min(e->vertices[0]->name, e->vertices[1]->name);
+}
+
+template <class P> static bool lowest_vertex_first(const P *a, const P *b)
+{
+	return lowest_name(a) < lowest_name(b);
+}
+
+void Mesh::reorder_vertices(Vertex_Order type)
 {
+	// The vertex graph of the triangles and edges goes to vertex_order();
+	// the vertices are renamed and the vertex list rebuilt in that order.
+	// Triangles and edges are stably sorted by their lowest vertex and
+	// renamed, so the index buffer walks the vertices forward as well.
+	// Everything stored per vertex name is dropped (the quantization
+	// too), the adjacency is rebuilt if there was one.
+	vector<Vertex*> old_names;
+	vector<int> offset, neighbors, order;
+	vector< pair<int, int> > pairs;
+	MatrixXf points;
 	list<Vertex*>::iterator iv;
-	MathVector con;
-	Vertex *best = NULL;
-	float best_length;
+	list<Triangle*>::iterator it;
+	list<Edge*>::iterator ie;
+	int n = vertices->size();
+	int rebuild = !adjacency.empty();
+	int i, j, k;
 
-	best_length=MAXFLOAT;
+	ver_nr = 0;
+	vertex_names.clear();
 	for (iv=vertices->begin(); iv != vertices->end(); iv++)
 	{
-		MathVector::sub((*iv)->math_data(), v->math_data(), &con);
-		if (con.length() < best_length)
+		(*iv)->name = ++ver_nr;
+		vertex_names.push_back(*iv);
+	}
+
+	for (it=triangles->begin(); it != triangles->end(); it++)
+		for (k=0; k < 3; k++)
 		{
-			best_length=con.length();
-			best=*iv;
+			i = (*it)->vertices[k]->name-1;
+			j = (*it)->vertices[(k+1)%3]->name-1;
+			pairs.push_back(make_pair(i, j));
+			pairs.push_back(make_pair(j, i));
 		}
+	for (ie=edges->begin(); ie != edges->end(); ie++)
+	{
+		i = (*ie)->vertices[0]->name-1;
+		j = (*ie)->vertices[1]->name-1;
+		pairs.push_back(make_pair(i, j));
+		pairs.push_back(make_pair(j, i));
+	}
+	sort(pairs.begin(), pairs.end());
+	pairs.erase(unique(pairs.begin(), pairs.end()), pairs.end());
+	offset.assign(n+1, 0);
+	neighbors.resize(pairs.size());
+	for (k=0; k < (int) pairs.size(); k++)
+	{
+		offset[pairs[k].first+1]++;
+		neighbors[k] = pairs[k].second;
 	}
+	for (i=0; i < n; i++)
+		offset[i+1] += offset[i];
+	points.resize(n, 3);
+	for (i=0; i < n; i++)
+		for (k=0; k < 3; k++)
+			points(i,k) = vertex_names[i]->float_data()[k];
 
-	return best;
+	vertex_order(type, offset, neighbors, points, &order);
+
+	old_names.swap(vertex_names);
+	vertices->clear();
+	ver_nr = 0;
+	for (k=0; k < n; k++)
+	{
+		old_names[order[k]]->name = ++ver_nr;
+		vertex_names.push_back(old_names[order[k]]);
+		vertices->push_back(old_names[order[k]]);
+	}
+
+	triangles->sort(lowest_vertex_first<Triangle>);
+	tri_nr = 0;
+	triangle_names.clear();
+	for (it=triangles->begin(); it != triangles->end(); it++)
+	{
+		(*it)->name = ++tri_nr;
+		triangle_names.push_back(*it);
+	}
+	edges->sort(lowest_vertex_first<Edge>);
+	edge_nr = 0;
+	edge_names.clear();
+	for (ie=edges->begin(); ie != edges->end(); ie++)
+	{
+		(*ie)->name = ++edge_nr;
+		edge_names.push_back(*ie);
+	}
+	renamed_vertices(rebuild);
+}
+
+void Mesh::renamed_vertices(int rebuild)
+{
+	// after the vertices got other names: drops everything stored per
+	// vertex name and rebuilds the adjacency (if rebuild), the index
+	// buffer and the positions
+	vertex_tree_valid = 0;
+	gram.resize(0, 0);
+	normal_pattern_analyzed = 0;
+	schwarz_parts.clear();
+	deltamesh.resize(0, 3);
+	gram_delta.resize(0, 3);
+	laplacian_coordinates.resize(0, 3);
+	quantized_coordinates.resize(0, 3);
+	quantized_indices.resize(0, 3);
+	vertex_mq.resize(0);
+	vertex_sq.resize(0);
+	if (rebuild)
+	{
+		build_adjacency();
+	}
+	else
+	{
+		adjacency_offset.clear();
+		adjacency.clear();
+		vertex_index.clear();
+	}
+	build_index_buffer();
+	gather_positions();
+}
+
+Vertex* Mesh::find_closed_point(const Vertex *v) const
+{
+	if (!vertex_tree_valid)
+	{
+		vertex_tree.build(vertices);
+		vertex_tree_valid = 1;
+	}
+
+	return vertex_tree.nearest(v->float_data());
+}
+
+void Mesh::find_closed_points(const MatrixXf &points,
+			      vector<Vertex*> *result) const
+{
+	if (!vertex_tree_valid)
+	{
+		vertex_tree.build(vertices);
+		vertex_tree_valid = 1;
+	}
+
+	vertex_tree.nearest(points, result);
 }
 
 void Mesh::write_gts_points(FILE *f) const
@@ -862,77 +1471,656 @@ void Mesh::ini_ner_ver()
 	{
 		(*iv)->get_neighborvertexs();
 	}
+	build_adjacency();
+	build_index_buffer();
+	gather_positions();
 }
-void Mesh::quantizing_laplacian_coordinates(int bit)
+
+void Mesh::build_index_buffer(void)
 {
-	MathVector c;
-	Vertex* current_vertex;
-	cout<<"bit: "<<bit<<endl;
-	for(list<Vertex*>::iterator iv=vertices->begin(); iv != vertices->end(); iv++)
+	triangle_indices.clear();
+	triangle_indices.reserve(3*triangles->size());
+	for(list<Triangle*>::iterator it = triangles->begin();it != triangles->end();it++)
 	{
-		c.set_zero();
-		current_vertex = (*iv);
-		for(list<Vertex*>::iterator ivv=current_vertex->neighborvertex.begin();ivv!=current_vertex->neighborvertex.end();ivv++)
+		for(int i=0;i<3;i++)
 		{
-			c.add((*ivv)->math_data());
+			triangle_indices.push_back((*it)->vertices[i]->name-1);
 		}
-		c.scale(1.0/current_vertex->neighborvertex.size());
-		c.sub(current_vertex->math_data());
-		c.negation();
-		current_vertex->lapcoor.set(c.v[0],c.v[1],c.v[2]);
-
-		/*if((*iv)->dye==0)
-			vesq.push_back((*iv));*/
 	}
-	float the_max;
-	float the_min;
-	float chazhi;
-	float max_error;
-	for(int i=0; i<3; i++)
+	original_surface_valid = 0;
+}
+
+void Mesh::gather_positions(void)
+{
+	//one row per name up to the largest, so that names left unused by
+	//remove() are zero rows and not out of bounds
+	int n = vertices->size();
+	int i;
+	list<Vertex*>::iterator iv;
+	for(iv=vertices->begin(); iv != vertices->end(); iv++)
+		n = max(n, (int)(*iv)->name);
+	positions.setZero(n,3);
+	new_positions.setZero(n,3);
+	for(iv=vertices->begin(); iv != vertices->end(); iv++)
 	{
-		the_max=-100;
-		the_min=100;
-		for(list<Vertex*>::iterator iv=vertices->begin(); iv != vertices->end(); iv++)
-		{
-			the_max = max(the_max,(*iv)->math_lapcoor()->v[i]);
-			the_min = min(the_min,(*iv)->math_lapcoor()->v[i]);
-		}
-		chazhi = the_max - the_min;
-		max_error = chazhi*pow(2.0,-bit);
-		cout<<"max_error: "<<max_error<<endl;
-		for(list<Vertex*>::iterator iv=vertices->begin(); iv != vertices->end(); iv++)
+		i = (*iv)->name-1;
+		for(int c=0;c<3;c++)
 		{
-			(*iv)->math_quantized_lapcoor()->v[i] = floor(((*iv)->math_lapcoor()->v[i]-the_min)/max_error +0.5)*max_error +the_min;
+			positions(i,c) = (*iv)->math_data()->v[c];
+			new_positions(i,c) = (*iv)->math_newdata()->v[c];
 		}
 	}
-	fstream f("documents\\quantized laplacian.txt",ios::out);
+	original_surface_valid = 0;
+	original_laplacian.resize(0,3);
+}
+
+void Mesh::store_reconstruction(const MatrixXf &result)
+{
+	int i;
+	new_positions = result.leftCols(3);
 	for(list<Vertex*>::iterator iv=vertices->begin(); iv != vertices->end(); iv++)
 	{
-		//f<<(*iv)->math_lapcoor()->v[0]<<" "<<(*iv)->math_lapcoor()->v[1]<<" "<<(*iv)->math_lapcoor()->v[2]<<" ";
-		f<<(*iv)->math_quantized_lapcoor()->v[0]<<" "<<(*iv)->math_quantized_lapcoor()->v[1]<<" "<<(*iv)->math_quantized_lapcoor()->v[2]<<endl;
+		i = (*iv)->name-1;
+		(*iv)->newdata.v[0] = new_positions(i,0);
+		(*iv)->newdata.v[1] = new_positions(i,1);
+		(*iv)->newdata.v[2] = new_positions(i,2);
 	}
-	f.close();
 }
 
-void Mesh::initialize_tripletList_and_deltamesh()
+void Mesh::build_adjacency(void)
 {
-	deltamesh=MatrixXf::Zero(vertices->size(),3);
-	int i,j;
-	tripletList.clear();
+	int n = vertices->size();
+	int i;
+	vertex_index.assign(n, (Vertex*)NULL);
+	adjacency_offset.assign(n+1, 0);
 	for(list<Vertex*>::iterator iv=vertices->begin(); iv != vertices->end(); iv++)
 	{
 		i = (*iv)->name-1;
-		tripletList.push_back(T(i, i, (*iv)->neighborvertex.size()));
-		for(int ii=0;ii<3;ii++)
+		vertex_index[i] = (*iv);
+		adjacency_offset[i+1] = (*iv)->neighborvertex.size();
+	}
+	for(i=0;i<n;i++)
+	{
+		adjacency_offset[i+1] += adjacency_offset[i];
+	}
+	adjacency.resize(adjacency_offset[n]);
+	for(i=0;i<n;i++)
+	{
+		int k = adjacency_offset[i];
+		for(list<Vertex*>::iterator ivv=vertex_index[i]->neighborvertex.begin();ivv!=vertex_index[i]->neighborvertex.end();ivv++)
 		{
-			deltamesh(i,ii)=((*iv)->math_quantized_lapcoor()->v[ii])*(*iv)->neighborvertex.size();
+			adjacency[k++] = (*ivv)->name-1;
 		}
-		for(list<Vertex*>::iterator ivv=((*iv)->neighborvertex).begin();ivv!=((*iv)->neighborvertex).end();ivv++)
-		{
-			j = (*ivv)->name-1;
-			tripletList.push_back(T(i, j, -1.0));
+	}
+	//L^T L, its analyzed pattern and the Schwarz parts belong to the old
+	//adjacency, even when the vertex count did not change
+	original_laplacian.resize(0,3);
+	gram.resize(0,0);
+	normal_pattern_analyzed = 0;
+	schwarz_parts.clear();
+}
+
+int Mesh::degree(int i) const
+{
+	return adjacency_offset[i+1]-adjacency_offset[i];
+}
+
+const int* Mesh::neighbors_begin(int i) const
+{
+	return adjacency.empty() ? NULL : &adjacency[0]+adjacency_offset[i];
+}
+
+const int* Mesh::neighbors_end(int i) const
+{
+	return adjacency.empty() ? NULL : &adjacency[0]+adjacency_offset[i+1];
+}
+
+Vertex* Mesh::vertex_at(int i) const
+{
+	return vertex_index[i];
+}
+void Mesh::quantizing_laplacian_coordinates(int bit)
+{
+	int n = vertex_index.size();
+	int i,k,c;
+	float s;
+	cout<<"bit: "<<bit<<endl;
+	gather_positions();
+	//delta = p - mean of the neighbors, one axis at a time
+	laplacian_coordinates.resize(n,3);
+	quantized_coordinates.resize(n,3);
+	quantized_indices.resize(n,3);
+	quantization_bits = bit;
+	for(c=0;c<3;c++)
+	{
+		const float *p = positions.col(c).data();
+		float *l = laplacian_coordinates.col(c).data();
+		for(i=0;i<n;i++)
+		{
+			s = 0;
+			for(k=adjacency_offset[i];k<adjacency_offset[i+1];k++)
+			{
+				s += p[adjacency[k]];
+			}
+			l[i] = p[i] - s*(float)(1.0/degree(i));
+		}
+	}
+	float the_max;
+	float the_min;
+	float chazhi;
+	float max_error;
+	for(c=0; c<3; c++)
+	{
+		const float *l = laplacian_coordinates.col(c).data();
+		float *q = quantized_coordinates.col(c).data();
+		int *qi = quantized_indices.col(c).data();
+		the_max = laplacian_coordinates.col(c).maxCoeff();
+		the_min = laplacian_coordinates.col(c).minCoeff();
+		chazhi = the_max - the_min;
+		max_error = chazhi*pow(2.0,-bit);
+		cout<<"max_error: "<<max_error<<endl;
+		quantization_min[c] = the_min;
+		quantization_step[c] = max_error;
+		for(i=0;i<n;i++)
+		{
+			double t = max_error > 0 ? floor((l[i]-the_min)/max_error +0.5) : 0;
+			qi[i] = t > 0 ? (int)min(t,pow(2.0,bit)) : 0;
+			q[i] = (double)qi[i]*max_error +the_min;
+		}
+	}
+	for(i=0;i<n;i++)
+	{
+		vertex_index[i]->lapcoor.set(laplacian_coordinates(i,0),laplacian_coordinates(i,1),laplacian_coordinates(i,2));
+		vertex_index[i]->quantized_lapcoor.set(quantized_coordinates(i,0),quantized_coordinates(i,1),quantized_coordinates(i,2));
+	}
+	vector<unsigned char> stream;
+	encode_quantized_laplacian(&stream);
+	cout<<"bits per vertex: "<<8.0*stream.size()/n<<endl;
+	FILE *f = fopen("documents\\quantized laplacian.bin","wb");
+	if(f != NULL)
+	{
+		fwrite(&stream[0],1,stream.size(),f);
+		fclose(f);
+	}
+}
+
+#define DELTA_MODEL_BITS 12
+
+int Mesh::encode_quantized_laplacian(vector<unsigned char> *out, const vector<int> *order) const
+{
+	//header: vertex count, bits, per-axis min and step; then the indices
+	//vertex by vertex through one adaptive model per axis. Above
+	//DELTA_MODEL_BITS bits the low bits are stored with flat probabilities.
+	//order gives the vertices in stream order, NULL for vertex_index order
+	int n = quantized_indices.rows();
+	int start = out->size();
+	int raw = max(quantization_bits - DELTA_MODEL_BITS, 0);
+	int symbols = (1 << (quantization_bits - raw)) + 1;
+	put_uint32(out, n);
+	out->push_back((unsigned char)quantization_bits);
+	for(int c=0;c<3;c++)
+	{
+		put_float(out, quantization_min[c]);
+		put_float(out, quantization_step[c]);
+	}
+	AdaptiveModel model0(symbols), model1(symbols), model2(symbols);
+	AdaptiveModel *model[3] = { &model0, &model1, &model2 };
+	RangeEncoder coder(out);
+	for(int i=0;i<n;i++)
+	{
+		for(int c=0;c<3;c++)
+		{
+			unsigned int q = quantized_indices(order ? (*order)[i] : i,c);
+			coder.encode(q >> raw, model[c]);
+			coder.encode_bits(q & ((1u << raw) - 1), raw);
+		}
+	}
+	coder.finish();
+	return out->size() - start;
+}
+
+static int decode_laplacian_stream(const unsigned char *data, int size, int n,
+	int *bits, float *qmin, float *qstep, MatrixXi *indices)
+{
+	//header and indices of a stream of encode_quantized_laplacian() for
+	//n vertices; returns the bytes used, -1 if it is damaged, made for
+	//another vertex count or too short for 3n symbols
+	const int header = 4 + 1 + 6*4;
+	int raw, symbols, i, c;
+	vector<int> q;
+	if(size < header || (int)get_uint32(data) != n || data[4] > 30)
+		return -1;
+	*bits = data[4];
+	for(c=0;c<3;c++)
+	{
+		qmin[c] = get_float(data + 5 + 8*c);
+		qstep[c] = get_float(data + 9 + 8*c);
+	}
+	raw = max(*bits - DELTA_MODEL_BITS, 0);
+	symbols = (1 << (*bits - raw)) + 1;
+	if(3.0*n > max_adaptive_symbols(symbols, size - header))
+		return -1;
+	AdaptiveModel model0(symbols), model1(symbols), model2(symbols);
+	AdaptiveModel *model[3] = { &model0, &model1, &model2 };
+	RangeDecoder coder(data + header, size - header);
+	//grows with the decoded data, not with the header count
+	for(i=0;i<n && !coder.overrun();i++)
+	{
+		for(c=0;c<3;c++)
+		{
+			q.push_back(coder.decode(model[c]) << raw);
+			q.back() |= coder.decode_bits(raw);
+		}
+	}
+	if(coder.overrun())
+		return -1;
+	indices->resize(n,3);
+	for(i=0;i<n;i++)
+		for(c=0;c<3;c++)
+			(*indices)(i,c) = q[3*i+c];
+	return header + coder.position();
+}
+
+int Mesh::decode_quantized_laplacian(const unsigned char *data, int size)
+{
+	//reads a stream of encode_quantized_laplacian(); returns the bytes
+	//used, -1 if the stream is damaged or not made for this mesh
+	MatrixXi indices;
+	int bits, used;
+	float qmin[3], qstep[3];
+	used = decode_laplacian_stream(data, size, vertex_index.size(), &bits, qmin, qstep, &indices);
+	if(used < 0)
+		return -1;
+	quantized_indices.swap(indices);
+	set_quantization(bits, qmin, qstep);
+	return used;
+}
+
+void Mesh::set_quantization(int bits, const float *qmin, const float *qstep)
+{
+	//quantized_coordinates and Vertex::quantized_lapcoor from the
+	//indices in quantized_indices
+	int n = quantized_indices.rows();
+	quantization_bits = bits;
+	for(int c=0;c<3;c++)
+	{
+		quantization_min[c] = qmin[c];
+		quantization_step[c] = qstep[c];
+	}
+	quantized_coordinates.resize(n,3);
+	for(int i=0;i<n;i++)
+	{
+		for(int c=0;c<3;c++)
+			quantized_coordinates(i,c) = (double)quantized_indices(i,c)*quantization_step[c] + quantization_min[c];
+		vertex_index[i]->quantized_lapcoor.set(quantized_coordinates(i,0),quantized_coordinates(i,1),quantized_coordinates(i,2));
+	}
+}
+
+#define CONTAINER_VERSION 1
+#define INDEX_CONNECTIVITY 0
+#define CUT_BORDER_CONNECTIVITY 1
+
+static void put_block(vector<unsigned char> *out, const vector<unsigned char> &block)
+{
+	put_uint32(out, block.size());
+	out->insert(out->end(), block.begin(), block.end());
+}
+
+static const unsigned char* get_block(const unsigned char **p, const unsigned char *end, int *size)
+{
+	//the block at *p, NULL if it runs past end
+	const unsigned char *block;
+	if(end - *p < 4)
+		return NULL;
+	*size = get_uint32(*p);
+	block = *p + 4;
+	if(*size < 0 || end - block < *size)
+		return NULL;
+	*p = block + *size;
+	return block;
+}
+
+int Mesh::write_compressed(FILE *f)
+{
+	//Laplacian-coded mesh, numbers little-endian: "LPMC", version,
+	//connectivity method, vertex and triangle count; then three blocks
+	//with their byte length in front: the connectivity, the stream of
+	//encode_quantized_laplacian() and the sorted anchor names; last the
+	//anchor coordinates as floats. Uses the current quantization
+	//(quantizing_laplacian_coordinates()) and the anchors in vesq.
+	//The connectivity is cut-border coded, which numbers the vertices in
+	//decoding order; meshes it cannot take keep their corner indices.
+	//Returns the bytes written, -1 without quantization or anchors; also
+	//-1 for what read_compressed() rejects: a triangle that repeats a
+	//corner, or a vertex in no triangle that is not an anchor
+	int n = vertices->size();
+	vector<unsigned char> out, block;
+	vector<int> anchors, order, position;
+	vector<char> placed;
+	int i, last;
+	if(n == 0 || ver_nr != n || quantized_indices.rows() != n || vesq.empty())
+		return -1;
+	placed.assign(n, 0);
+	for(list<Triangle*>::iterator it=triangles->begin(); it != triangles->end(); it++)
+	{
+		Vertex **v = (*it)->vertices;
+		if(v[0] == v[1] || v[1] == v[2] || v[0] == v[2])
+			return -1;
+		for(int k=0;k<3;k++)
+			placed[v[k]->name-1] = 1;
+	}
+	for(vector<Vertex*>::size_type st=0;st<vesq.size();st++)
+		placed[vesq[st]->name-1] = 1;
+	if(find(placed.begin(), placed.end(), 0) != placed.end())
+		return -1;
+	out.push_back('L');
+	out.push_back('P');
+	out.push_back('M');
+	out.push_back('C');
+	out.push_back(CONTAINER_VERSION);
+	out.push_back(encode_connectivity(triangles, n, &block, &order) == 0 ? CUT_BORDER_CONNECTIVITY : INDEX_CONNECTIVITY);
+	put_uint32(&out, n);
+	put_uint32(&out, triangles->size());
+
+	//else corners as differences to the previous corner
+	if(order.empty())
+	{
+		AdaptiveModel lengths(NUMBER_SYMBOLS);
+		RangeEncoder coder(&block);
+		last = 0;
+		for(list<Triangle*>::iterator it=triangles->begin(); it != triangles->end(); it++)
+		{
+			for(int k=0;k<3;k++)
+			{
+				i = (*it)->vertices[k]->name-1;
+				coder.encode_number(zigzag(i-last), &lengths);
+				last = i;
+			}
 		}
+		coder.finish();
+	}
+	put_block(&out, block);
+
+	block.clear();
+	encode_quantized_laplacian(&block, order.empty() ? NULL : &order);
+	put_block(&out, block);
+
+	//anchors by their decoded number as gaps, duplicates dropped
+	position.resize(n);
+	for(i=0;i<n;i++)
+		position[order.empty() ? i : order[i]] = i;
+	for(vector<Vertex*>::size_type st=0;st<vesq.size();st++)
+		anchors.push_back(position[vesq[st]->name-1]);
+	sort(anchors.begin(), anchors.end());
+	anchors.erase(unique(anchors.begin(), anchors.end()), anchors.end());
+	block.clear();
+	{
+		AdaptiveModel lengths(NUMBER_SYMBOLS);
+		RangeEncoder coder(&block);
+		last = -1;
+		for(i=0;i<(int)anchors.size();i++)
+		{
+			coder.encode_number(anchors[i]-last-1, &lengths);
+			last = anchors[i];
+		}
+		coder.finish();
+	}
+	put_uint32(&out, anchors.size());
+	put_block(&out, block);
+	for(i=0;i<(int)anchors.size();i++)
+		for(int c=0;c<3;c++)
+			put_float(&out, vertex_names[order.empty() ? anchors[i] : order[anchors[i]]]->float_data()[c]);
+
+	if(fwrite(&out[0], 1, out.size(), f) != out.size())
+		return -1;
+	return out.size();
+}
+
+int Mesh::read_compressed(FILE *f)
+{
+	//decodes a file of write_compressed() into this mesh: rebuilds the
+	//triangles and edges, then solves for the positions from the
+	//quantized delta coordinates and the anchors. All blocks are decoded
+	//and checked first, a damaged file leaves the mesh as it was. Returns
+	//7 when memory runs out; after the mesh was cleared it stays empty
+	vector<unsigned char> file;
+	vector<Vertex*> ver_array;
+	vector<int> anchors, indices;
+	vector<char> placed;
+	list<Triangle*> *shape_triangles;
+	list<Vertex*> *shape_vertices;
+	const unsigned char *p, *end, *connectivity, *deltas, *anchor_block;
+	int n, t, a, connectivity_size, deltas_size, anchor_size, i, k, method, bits;
+	__int64 last;
+	float qmin[3], qstep[3];
+	MatrixXi delta_indices;
+	long length;
+
+	fseek(f, 0, SEEK_END);
+	length = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	if(length < 14)
+	{
+		FILE_ERROR(f, "LPMC file format error: too short");
+		return 3;
 	}
+	try
+	{
+		file.resize(length);
+		if(fread(&file[0], 1, length, f) != (size_t)length)
+		{
+			FILE_ERROR(f, "LPMC file format error: read failed");
+			return 3;
+		}
+		p = &file[0];
+		end = p + length;
+		method = p[5];
+		if(memcmp(p, "LPMC", 4) != 0 || p[4] != CONTAINER_VERSION
+			|| (method != INDEX_CONNECTIVITY && method != CUT_BORDER_CONNECTIVITY))
+		{
+			FILE_ERROR(f, "LPMC file format error: unknown magic number or version");
+			return 3;
+		}
+		n = get_uint32(p+6);
+		t = get_uint32(p+10);
+		p += 14;
+		//3*t indices have to fit into an int
+		if(n <= 0 || t < 0 || t > INT_MAX / 3)
+		{
+			FILE_ERROR(f, "LPMC file format error: counts");
+			return 3;
+		}
+
+		if((connectivity = get_block(&p, end, &connectivity_size)) == NULL)
+		{
+			FILE_ERROR(f, "LPMC file format error: connectivity");
+			return 4;
+		}
+		if((deltas = get_block(&p, end, &deltas_size)) == NULL)
+		{
+			FILE_ERROR(f, "LPMC file format error: delta coordinates");
+			return 5;
+		}
+		if(end - p < 4)
+		{
+			FILE_ERROR(f, "LPMC file format error: anchors");
+			return 6;
+		}
+		a = get_uint32(p);
+		p += 4;
+		if(a <= 0 || a > n || (anchor_block = get_block(&p, end, &anchor_size)) == NULL || end - p < 12*a)
+		{
+			FILE_ERROR(f, "LPMC file format error: anchors");
+			return 6;
+		}
+		//every triangle takes at least one adaptive symbol of the connectivity
+		//block, three with corner indices, and every vertex three of the delta
+		//block (checked in decode_laplacian_stream()); a vertex that is in no
+		//triangle has to be an anchor, checked once all is decoded
+		if(method == CUT_BORDER_CONNECTIVITY ? t > max_adaptive_symbols(2, connectivity_size)
+			: 3.0*t > max_adaptive_symbols(NUMBER_SYMBOLS, connectivity_size))
+		{
+			FILE_ERROR(f, "LPMC file format error: counts");
+			return 3;
+		}
+		if(n - a > 3*t)
+		{
+			FILE_ERROR(f, "LPMC file format error: counts");
+			return 3;
+		}
+
+		if(method == CUT_BORDER_CONNECTIVITY)
+		{
+			if(decode_connectivity(connectivity, connectivity_size, n, t, &indices) < 0)
+			{
+				FILE_ERROR(f, "LPMC file format error: connectivity");
+				return 4;
+			}
+		}
+		else
+		{
+			AdaptiveModel lengths(NUMBER_SYMBOLS);
+			RangeDecoder coder(connectivity, connectivity_size);
+			last = 0;
+			//t is only a header count: stop as soon as the block is used up
+			for(i=0;i<3*t;i++)
+			{
+				if(coder.overrun())
+				{
+					FILE_ERROR(f, "LPMC file format error: connectivity");
+					return 4;
+				}
+				last += unzigzag(coder.decode_number(&lengths));
+				if(last < 0 || last >= n)
+				{
+					FILE_ERROR(f, "LPMC file format error: vertex index out of range");
+					return 4;
+				}
+				indices.push_back((int)last);
+				if(i%3 == 2 && (indices[i] == indices[i-1] || indices[i] == indices[i-2] || indices[i-1] == indices[i-2]))
+				{
+					FILE_ERROR(f, "LPMC file format error: degenerate triangle");
+					return 4;
+				}
+			}
+			if(coder.overrun())
+			{
+				FILE_ERROR(f, "LPMC file format error: connectivity");
+				return 4;
+			}
+		}
+
+		if(decode_laplacian_stream(deltas, deltas_size, n, &bits, qmin, qstep, &delta_indices) < 0)
+		{
+			FILE_ERROR(f, "LPMC file format error: delta coordinates");
+			return 5;
+		}
+
+		{
+			AdaptiveModel lengths(NUMBER_SYMBOLS);
+			RangeDecoder coder(anchor_block, anchor_size);
+			last = -1;
+			for(i=0;i<a;i++)
+			{
+				last += (__int64)coder.decode_number(&lengths) + 1;
+				if(last >= n)
+				{
+					FILE_ERROR(f, "LPMC file format error: anchor out of range");
+					return 6;
+				}
+				anchors.push_back((int)last);
+			}
+		}
+
+		placed.assign(n, 0);
+		for(k=0;k<(int)indices.size();k++)
+			placed[indices[k]] = 1;
+		for(i=0;i<a;i++)
+			placed[anchors[i]] = 1;
+		if(find(placed.begin(), placed.end(), 0) != placed.end())
+		{
+			FILE_ERROR(f, "LPMC file format error: vertex without triangle or anchor");
+			return 6;
+		}
+	}
+	catch(bad_alloc&)
+	{
+		FILE_ERROR(f, "LPMC file format error: out of memory");
+		return 7;
+	}
+
+	try
+	{
+		clear();
+		vertex_pool.reserve(n);
+		shape_triangles = new list<Triangle*>;
+		shape_vertices = new list<Vertex*>;
+		for(i=0;i<n;i++)
+		{
+			ver_array.push_back(new_vertex(0,0,0));
+			add_vertex(ver_array.back());
+		}
+		shape_vertices->insert(shape_vertices->begin(), ver_array.begin(), ver_array.end());
+		shapes->push_back(new_shape(shape_triangles, shape_vertices));
+		triangle_pool.reserve(t);
+		for(i=0;i<t;i++)
+		{
+			Triangle *tri = new_triangle(ver_array[indices[3*i]], ver_array[indices[3*i+1]], ver_array[indices[3*i+2]]);
+			add_triangle(tri);
+			shape_triangles->push_back(tri);
+		}
+		create_edges();
+		ini_ner_ver();
+		quantized_indices.swap(delta_indices);
+		set_quantization(bits, qmin, qstep);
+
+		vesq.clear();
+		for(i=0;i<a;i++)
+		{
+			MathVector c(get_float(p), get_float(p+4), get_float(p+8));
+			p += 12;
+			ver_array[anchors[i]]->set(&c);
+			vesq.push_back(ver_array[anchors[i]]);
+		}
+
+		//least squares reconstruction, as solving_least_squares()
+		MatrixXf delta(n,3), result;
+		for(i=0;i<n;i++)
+			delta.row(i) = quantized_coordinates.row(i)*(float)degree(i);
+		laplacian_transpose_product(delta, &gram_delta);
+		solve_anchored_system(a, &result);
+		store_reconstruction(result);
+		for(i=0;i<n;i++)
+		{
+			MathVector c(result(i,0), result(i,1), result(i,2));
+			vertex_index[i]->set(&c);
+		}
+		for(list<Triangle*>::iterator it=triangles->begin(); it != triangles->end(); it++)
+			(*it)->calc_properties();
+		for(list<Edge*>::iterator ie=edges->begin(); ie != edges->end(); ie++)
+			(*ie)->calc_properties();
+		gather_positions();
+		vertex_tree_valid = 0;
+	}
+	catch(bad_alloc&)
+	{
+		clear();
+		FILE_ERROR(f, "LPMC file format error: out of memory");
+		return 7;
+	}
+	return 0;
+}
+
+void Mesh::initialize_tripletList_and_deltamesh()
+{
+	//right-hand side only: the solvers that need L^T L build it themselves
+	deltamesh=MatrixXf::Zero(vertices->size(),3);
+	int i,n = vertex_index.size();
+	for(i=0;i<n;i++)
+	{
+		deltamesh.row(i) = quantized_coordinates.row(i)*(float)degree(i);
+	}
+	laplacian_transpose_product(deltamesh, &gram_delta);
 	/*srand( (unsigned)time( NULL ) );
 	int rr = rand()%vertices->size();
 	*list<Vertex*>::iterator iv=vertices->begin();
@@ -963,55 +2151,386 @@ void Mesh::initialize_tripletList_and_deltamesh()
 	}*/
 }
 
-void Mesh::iterator_soving_least_square(int anchor)
+void Mesh::initialize_gram(void)
 {
-	SpMat slaplacian((vertices->size()+anchor),vertices->size());
-	MatrixXf delta = MatrixXf::Zero(vertices->size()+anchor,3);
-	vector<T> temptripletList(tripletList);
-	//cout<<"test..temptripletList size:"<<temptripletList.size()<<endl;
-	for(int i=0;i<vertices->size();i++)
+	int n = vertices->size();
+	int i,k;
+	if(gram.rows() == n)
+		return;
+	//L^T L only depends on the connectivity, build it once per mesh
+	vector<T> triplets;
+	SpMatR slaplacian(n,n);
+	triplets.reserve(n+adjacency.size());
+	for(i=0;i<n;i++)
 	{
-		delta.row(i) = deltamesh.row(i);
+		triplets.push_back(T(i, i, degree(i)));
+		for(k=adjacency_offset[i];k<adjacency_offset[i+1];k++)
+		{
+			triplets.push_back(T(i, adjacency[k], -1.0));
+		}
 	}
-	int appended = vertices->size();
+	slaplacian.setFromTriplets(triplets.begin(), triplets.end());
+	gram = slaplacian.transpose()*slaplacian;
+	gram.makeCompressed();
+	normal_pattern_analyzed = 0;
+	schwarz_parts.clear();
+}
+
+void Mesh::laplacian_transpose_product(const MatrixXf &d, MatrixXf *result) const
+{
+	//the uniform Laplacian is symmetric, so L^T d is the stencil applied to d
+	int i,k,c,n = d.rows();
+	float s;
+	result->resize(n,d.cols());
+	for(c=0;c<d.cols();c++)
+	{
+		const float *x = d.col(c).data();
+		float *y = result->col(c).data();
+		for(i=0;i<n;i++)
+		{
+			s = x[i]*(float)degree(i);
+			for(k=adjacency_offset[i];k<adjacency_offset[i+1];k++)
+			{
+				s -= x[adjacency[k]];
+			}
+			y[i] = s;
+		}
+	}
+}
+
+void Mesh::assemble_anchored_system(int anchor, SpMatd *A, MatrixXf *b) const
+{
 	int j;
-	for(vector<Vertex*>::size_type st=0;st<vesq.size();st++)
+	//L^T L is symmetric, so its CSR arrays are also its CSC arrays
+	*A = gram.transpose().cast<double>();
+	*b = gram_delta;
+	for(int st=0;st<anchor;st++)
 	{
 		j = vesq[st]->name-1;
-		temptripletList.push_back(T(appended, j, 1));
+		A->coeffRef(j,j) += 1.0;
 		for(int i=0;i<3;i++)
 		{
-			delta(appended,i)=vesq[st]->math_data()->v[i];
+			(*b)(j,i) += vesq[st]->math_data()->v[i];
 		}
-		appended++;
 	}
-	slaplacian.setFromTriplets(temptripletList.begin(), temptripletList.end());
-	//soving
-	SpMat A = slaplacian.transpose()*slaplacian;
-	SparseLU<SparseMatrix<float>, COLAMDOrdering<int> > lu;
-	lu.analyzePattern(A);
-	lu.factorize(A);
-	MatrixXf deltaa = slaplacian.transpose()*delta;
-	MatrixXf result = lu.solve(deltaa);
-
-	temptripletList.clear();
-	//save
-	for(list<Vertex*>::iterator iv=vertices->begin(); iv != vertices->end(); iv++)
+}
+
+void Mesh::set_solver_type(Solver_Type type)
+{
+	delete normal_solver;
+	normal_solver = NULL;
+	normal_pattern_analyzed = 0;
+	delete schwarz_solver;
+	schwarz_solver = NULL;
+	schwarz_parts.clear();
+	solver_type = type;
+}
+
+void Mesh::set_pcg_tolerance(float tolerance, int max_iterations)
+{
+	pcg_tolerance = tolerance;
+	pcg_max_iterations = max_iterations;
+}
+
+void Mesh::apply_anchored_operator(const VectorXd &weight, const MatrixXd &x, MatrixXd *y) const
+{
+	//y = (L^T L + A^T A) x without assembling L: two passes of the stencil
+	//deg*x_i - sum(x_j), L is symmetric so L^T = L
+	int i,k,c,n = x.rows();
+	double s;
+	VectorXd t(n);
+	y->resize(n,x.cols());
+	for(c=0;c<x.cols();c++)
+	{
+		const double *xc = x.col(c).data();
+		double *yc = y->col(c).data();
+		for(i=0;i<n;i++)
+		{
+			s = xc[i]*degree(i);
+			for(k=adjacency_offset[i];k<adjacency_offset[i+1];k++)
+			{
+				s -= xc[adjacency[k]];
+			}
+			t(i) = s;
+		}
+		for(i=0;i<n;i++)
+		{
+			s = t(i)*degree(i) + xc[i]*weight(i);
+			for(k=adjacency_offset[i];k<adjacency_offset[i+1];k++)
+			{
+				s -= t(adjacency[k]);
+			}
+			yc[i] = s;
+		}
+	}
+}
+
+class AnchoredOperator : public PCGOperator
+{
+	//L^T L + A^T A through Mesh::apply_anchored_operator(), with the
+	//inverse of its diagonal as Jacobi preconditioner
+public:
+	AnchoredOperator(const Mesh *mesh, const VectorXd &weight, const VectorXd &inv_diag)
+		: mesh(mesh), weight(weight), inv_diag(inv_diag) {}
+	void multiply(const MatrixXd &x, MatrixXd *y) const
 	{
-		(*iv)->newdata.v[0] = (result.col(0))((*iv)->name-1);
-		(*iv)->newdata.v[1] = (result.col(1))((*iv)->name-1);
-		(*iv)->newdata.v[2] = (result.col(2))((*iv)->name-1);
+		mesh->apply_anchored_operator(weight, x, y);
 	}
+	void precondition(const MatrixXd &r, MatrixXd *z) const
+	{
+		*z = inv_diag.asDiagonal()*r;
+	}
+private:
+	const Mesh *mesh;
+	const VectorXd &weight;
+	const VectorXd &inv_diag;
+};
 
+int Mesh::pcg_solve_anchored_system(int anchor, MatrixXf *result)
+{
+	//Jacobi preconditioned conjugate gradient, the three coordinates run in
+	//lockstep and start from the current newdata
+	int n = vertices->size();
+	int i, j, c, deg, iterations;
+	VectorXd weight = VectorXd::Zero(n);
+	VectorXd inv_diag(n);
+	MatrixXd b = gram_delta.cast<double>();
+	MatrixXd x(n,3);
+	for(int st=0;st<anchor;st++)
+	{
+		j = vesq[st]->name-1;
+		weight(j) += 1.0;
+		for(c=0;c<3;c++)
+		{
+			b(j,c) += vesq[st]->math_data()->v[c];
+		}
+	}
+	for(i=0;i<n;i++)
+	{
+		deg = degree(i);
+		//diagonal of L^T L is deg^2 + deg
+		inv_diag(i) = 1.0/(deg*deg + deg + weight(i));
+	}
+	if(new_positions.rows() == n)
+		x = new_positions.cast<double>();
+	else
+		x.setZero();
+	AnchoredOperator op(this, weight, inv_diag);
+	iterations = pcg_solve(op, b, &x, pcg_tolerance, pcg_max_iterations);
+	*result = x.cast<float>();
+	if(iterations < 0)
+	{
+		cout<<"pcg: no convergence after "<<pcg_max_iterations<<" iterations"<<endl;
+		return 1;
+	}
+	return 0;
+}
+
+void Mesh::set_schwarz_overlap(int rings)
+{
+	delete schwarz_solver;
+	schwarz_solver = NULL;
+	schwarz_parts.clear();
+	schwarz_overlap = rings;
+}
+
+int Mesh::schwarz_solve_anchored_system(int anchor, MatrixXf *result)
+{
+	//the system and stopping rule of pcg_solve_anchored_system(), with
+	//SchwarzSolver as preconditioner on the segment_graph() partitions
+	//(superlist). Vertices outside of them form one more partition, so
+	//without segmentation the whole mesh is a single subdomain. The
+	//solver is kept while the partitions and L^T L stay the same, then
+	//a new anchor only refactors the subdomains around it. Returns 1 without
+	//convergence, 2 if a subdomain factorization failed
+	int n = vertices->size();
+	int i, j, c, iterations;
+	vector< vector<int> > parts;
+	vector<int> rest;
+	vector<char> covered(n, 0);
+	VectorXd weight = VectorXd::Zero(n);
+	MatrixXd b = gram_delta.cast<double>();
+	MatrixXd x(n,3);
+	for(vector<list<Vertex*>>::size_type liv=0;liv<superlist.size();liv++)
+	{
+		parts.push_back(vector<int>());
+		for(list<Vertex*>::iterator it=superlist[liv].begin();it!=superlist[liv].end();it++)
+		{
+			i = (*it)->name-1;
+			if(!covered[i])
+			{
+				covered[i] = 1;
+				parts.back().push_back(i);
+			}
+		}
+	}
+	for(i=0;i<n;i++)
+	{
+		if(!covered[i])
+			rest.push_back(i);
+	}
+	if(!rest.empty())
+		parts.push_back(rest);
+	for(int st=0;st<anchor;st++)
+	{
+		j = vesq[st]->name-1;
+		weight(j) += 1.0;
+		for(c=0;c<3;c++)
+		{
+			b(j,c) += vesq[st]->math_data()->v[c];
+		}
+	}
+	if(schwarz_solver == NULL)
+	{
+		schwarz_solver = new SchwarzSolver(schwarz_overlap);
+		schwarz_parts.clear();
+	}
+	if(parts != schwarz_parts)
+	{
+		initialize_gram();
+		schwarz_solver->set_gram(&gram);
+		schwarz_solver->set_partitions(parts, adjacency_offset, adjacency);
+		schwarz_parts = parts;
+	}
+	if(new_positions.rows() == n)
+		x = new_positions.cast<double>();
+	else
+		x.setZero();
+	if(schwarz_solver->factorize(weight))
+	{
+		cout<<"schwarz: factorization of a subdomain failed"<<endl;
+		*result = x.cast<float>();
+		return 2;
+	}
+	iterations = schwarz_solver->solve(b, &x, pcg_tolerance, pcg_max_iterations);
+	*result = x.cast<float>();
+	if(iterations < 0)
+	{
+		cout<<"schwarz: no convergence after "<<pcg_max_iterations<<" iterations"<<endl;
+		return 1;
+	}
+	return 0;
+}
+
+int Mesh::solve_anchored_system(int anchor, MatrixXf *result)
+{
+	//1 if a factorization failed; iterations that do not converge are
+	//only reported, their result is still the best there is
+	SpMatd A;
+	MatrixXf b;
+	MatrixXd x;
+	int failed = 0;
+	if(solver_type == PCG_SOLVER)
+	{
+		pcg_solve_anchored_system(anchor, result);
+		return 0;
+	}
+	if(solver_type == SCHWARZ_SOLVER)
+		return schwarz_solve_anchored_system(anchor, result) == 2;
+	initialize_gram();
+	assemble_anchored_system(anchor, &A, &b);
+	if(normal_solver == NULL)
+	{
+		normal_solver = NormalSolver::create(solver_type);
+	}
+	//anchors only change values on the diagonal
+	if(!normal_pattern_analyzed)
+	{
+		normal_solver->analyze_pattern(&A);
+		normal_pattern_analyzed = 1;
+	}
+	if(normal_solver->factorize(&A))
+	{
+		cout<<"factorization failed, "<<anchor<<" anchors"<<endl;
+		failed = 1;
+	}
+	normal_solver->solve(b.cast<double>(), &x);
+	*result = x.cast<float>();
+	return failed;
+}
+
+int Mesh::iterator_soving_least_square(int anchor)
+{
+	MatrixXf result;
+	int failed;
+	//soving
+	failed = solve_anchored_system(anchor, &result);
+
+	//save
+	store_reconstruction(result);
+	return failed;
 }
 
 void Mesh::iterator_compute_number(int num)//êӵٸ
 {
-	double temp;
-	for(int i=0;i<num;i++)
+	int added, k;
+	greedy_round = greedy_batch;
+	greedy_round_floor = 0;
+	if(solver_type == PCG_SOLVER || solver_type == SCHWARZ_SOLVER)
 	{
-		iterator_soving_least_square(vesq.size());
-		visual_quality_measure_for_greedy();
+		//iterative mode: every solve warm-starts from the last newdata
+		for(added=0;added<num;added+=k)
+		{
+			if(iterator_soving_least_square(vesq.size()))
+			{
+				cout<<"greedy: factorization failed, stopping at "<<vesq.size()<<" anchors"<<endl;
+				return;
+			}
+			if((k = select_greedy_anchors(num-added)) == 0)
+			{
+				cout<<"greedy: no finite Mq, stopping at "<<vesq.size()<<" anchors"<<endl;
+				return;
+			}
+		}
+		return;
+	}
+	AnchorSolver solver(solver_type);
+	vector<int> anchors;
+	MatrixXf result;
+	//factor L^T L once, every new anchor is a rank-one update
+	initialize_gram();
+	solver.set_gram(&gram);
+	for(vector<Vertex*>::size_type st=0;st<vesq.size();st++)
+	{
+		anchors.push_back(vesq[st]->name-1);
+	}
+	if(solver.factorize(anchors))
+	{
+		cout<<"greedy: factorization failed, stopping at "<<vesq.size()<<" anchors"<<endl;
+		return;
+	}
+	MatrixXf delta = gram_delta;
+	for(vector<Vertex*>::size_type st=0;st<vesq.size();st++)
+	{
+		for(int ii=0;ii<3;ii++)
+		{
+			delta(vesq[st]->name-1,ii) += vesq[st]->math_data()->v[ii];
+		}
+	}
+	for(added=0;added<num;added+=k)
+	{
+		solver.solve(delta, &result);
+		store_reconstruction(result);
+		if((k = select_greedy_anchors(num-added)) == 0)
+		{
+			cout<<"greedy: no finite Mq, stopping at "<<vesq.size()<<" anchors"<<endl;
+			return;
+		}
+		if(added+k<num)
+		{
+			for(vector<Vertex*>::size_type st=vesq.size()-k;st<vesq.size();st++)
+			{
+				if(solver.add_anchor(vesq[st]->name-1))
+				{
+					cout<<"greedy: factorization failed, stopping at "<<vesq.size()<<" anchors"<<endl;
+					return;
+				}
+				for(int ii=0;ii<3;ii++)
+				{
+					delta(vesq[st]->name-1,ii) += vesq[st]->math_data()->v[ii];
+				}
+			}
+		}
 		//cout<<"ֵ "<<temp<<endl;
 		/*if(i%10==9)
 			cout<<"...................."<<endl;*/
@@ -1097,64 +2616,54 @@ void Mesh::ccccc()
 
 void Mesh::BFS_Graph(Vertex *anchor, int i)
 {
-	
-	anchor->to_anthor_length = 0;//Ϊanchor
-	anchor->is_visited = true;
-	queue<Vertex*> q1;
-	vector<Vertex*> temp;
-	q1.push(anchor);
-	int count = 1;
+	//farthest point sampling: every new anchor relaxes to_anthor_length by a
+	//BFS that only enters vertices it gets closer to, the next anchor is the
+	//vertex farthest from all anchors, taken from a max-heap whose outdated
+	//entries are dropped lazily (distances only shrink)
+	int n = vertex_index.size();
+	int d, i1, k;
 	Vertex *te;
-	Vertex *max_length;
-	//max_length = anchor;
-	while(!q1.empty())
+	const vector<Vertex*> &index = vertex_index;
+	vector< pair<int,int> > heap;
+	queue<Vertex*> q1;
+	heap.reserve(n);
+	for(i1=0;i1<n;i1++)
+	{
+		heap.push_back(make_pair(index[i1]->to_anthor_length,-i1));
+	}
+	make_heap(heap.begin(),heap.end());
+	while(anchor != NULL)
 	{
-		te = q1.front();
-		q1.pop();
-		for(list<Vertex*>::iterator it = te->neighborvertex.begin(); it != te->neighborvertex.end();it++)
+		anchor->to_anthor_length = 0;//Ϊanchor
+		q1.push(anchor);
+		while(!q1.empty())
 		{
-			if(!(*it)->is_visited)//δ
+			te = q1.front();
+			q1.pop();
+			d = te->to_anthor_length+1;
+			i1 = te->name-1;
+			for(k=adjacency_offset[i1];k<adjacency_offset[i1+1];k++)
 			{
-				(*it)->is_visited = true;
-				if((*it)->to_anthor_length > count)
+				if(index[adjacency[k]]->to_anthor_length > d)
 				{
-					(*it)->to_anthor_length = count;
-					/*if(max_length->to_anthor_length < count)
-					{
-						max_length = (*it);
-					}*/
+					index[adjacency[k]]->to_anthor_length = d;
+					heap.push_back(make_pair(d,-adjacency[k]));
+					push_heap(heap.begin(),heap.end());
+					q1.push(index[adjacency[k]]);
 				}
-				temp.push_back((*it));
 			}
 		}
-		if(q1.empty())
+		while(!heap.empty() && heap.front().first != index[-heap.front().second]->to_anthor_length)
 		{
-			for(vector<Vertex*>::size_type st =0;st<temp.size();st++)
-			{
-				q1.push(temp[st]);
-			}
-			temp.clear();
-			count++;
+			pop_heap(heap.begin(),heap.end());
+			heap.pop_back();
+		}
+		anchor = NULL;
+		if(!heap.empty() && heap.front().first > i)
+		{
+			anchor = index[-heap.front().second];
 		}
 	}
-	for(list<Vertex*>::iterator iv=vertices->begin(); iv != vertices->end(); iv++)
-	{
-		(*iv)->is_visited = false;
-	}
-	sort(ver.begin(),ver.end(),Sqlarge);
-	max_length = ver[0];
-	
-	//cout<<"ǰtopoСֵ: "<<max_length->to_anthor_length<<endl;
-	if(max_length->to_anthor_length > i)
-	{
-		BFS_Graph(max_length,i);
-	}
-	
-	//if(i>0)
-	//{
-	//	i--;
-	//	BFS_Graph(max_length,i);
-	//}
 }
 
 void Mesh::test_anchor(int bit, fstream &fs, string &ss)
@@ -1167,7 +2676,6 @@ void Mesh::test_anchor(int bit, fstream &fs, string &ss)
 	initialize_tripletList_and_deltamesh();
 	for(list<Vertex*>::iterator iv=vertices->begin(); iv != vertices->end(); iv++)
 	{
-		ver.push_back((*iv));
 		(*iv)->to_anthor_length = 99999;
 	}
 	for(int i=24;i>=5;i--)
@@ -1201,7 +2709,6 @@ void Mesh::test_anchor(int bit, fstream &fs, string &ss)
 		fs<<cevis[st]<<" "<<anchorsize[st]<<endl;
 	}
 	fs<<" "<<" "<<" "<<endl;
-	ver.clear();
 	anchorsize.clear();
 	cevis.clear();
 	cout<<"running............"<<endl;
@@ -1222,14 +2729,101 @@ void Mesh::test_anchor(int bit, fstream &fs, string &ss)
 	
 }
 
-void Mesh::test_anchor1()
+void Mesh::test_anchor_sweep(int first_bit, int last_bit, fstream &fs, string &ss)
 {
-	quantizing_laplacian_coordinates(8);
-	initialize_tripletList_and_deltamesh();
+	FILE *f;
+	int bits = last_bit-first_bit+1;
+	int n = vertices->size();
+	vector<int> anchorsize;
+	vector<char> anchored(n,0);
+	vector<int> anchors;
+	string st;
+	AnchorSolver solver(solver_type);
+	MatrixXf deltas(n,3*bits);
+	MatrixXf delta, result;
+	MatrixXd hausdorff(20,bits);
+	//the system matrix only depends on connectivity and anchors, so all
+	//bit depths share one right-hand side block and one factorization
+	for(int bit=first_bit;bit<=last_bit;bit++)
+	{
+		quantizing_laplacian_coordinates(bit);
+		initialize_tripletList_and_deltamesh();
+		deltas.middleCols(3*(bit-first_bit),3) = gram_delta;
+	}
+	initialize_gram();
+	solver.set_gram(&gram);
 	for(list<Vertex*>::iterator iv=vertices->begin(); iv != vertices->end(); iv++)
 	{
-		ver.push_back((*iv));
+		(*iv)->to_anthor_length = 99999;
+	}
+	for(int i=24;i>=5;i--)
+	{
+		BFS_Graph(first_anchor,i);
+		vesq.clear();
+		for(list<Vertex*>::iterator iv=vertices->begin(); iv != vertices->end(); iv++)
+		{
+			if((*iv)->to_anthor_length == 0)
+			{
+				vesq.push_back((*iv));
+			}
+		}
+		anchorsize.push_back(vesq.size());
+		//the anchor sets grow monotonically, new anchors are rank-one updates
+		delta = deltas;
+		for(vector<Vertex*>::size_type sy=0;sy<vesq.size();sy++)
+		{
+			int j = vesq[sy]->name-1;
+			if(!anchored[j])
+			{
+				anchored[j] = 1;
+				anchors.push_back(j);
+				if(i<24)
+					solver.add_anchor(j);
+			}
+			for(int b=0;b<bits;b++)
+				for(int ii=0;ii<3;ii++)
+					delta(j,3*b+ii) += vesq[sy]->math_data()->v[ii];
+		}
+		if(i==24)
+			solver.factorize(anchors);
+		solver.solve(delta, &result);
+		ccccc();
+		for(int b=0;b<bits;b++)
+		{
+			store_reconstruction(result.middleCols(3*b,3));
+			hausdorff_distance_1();
+			hausdorff(24-i,b) = cevis.back();
+			st = ss;
+			st.append("b");
+			st.append(convertToString(first_bit+b));
+			st.append("BFS");
+			st.append(convertToString(i));
+			st.append(".ply");
+			if((f=fopen(st.c_str(),"w"))==NULL)
+			{
+				exit(0);
+			}
+			write(f, "VCGLIB generated");
+			fclose(f);
+		}
+	}
+	for(int b=0;b<bits;b++)
+	{
+		for(vector<int>::size_type sy=0;sy<anchorsize.size();sy++)
+		{
+			fs<<hausdorff(sy,b)<<" "<<anchorsize[sy]<<endl;
+		}
+		fs<<" "<<" "<<" "<<endl;
 	}
+	anchorsize.clear();
+	cevis.clear();
+	cout<<"running............"<<endl;
+}
+
+void Mesh::test_anchor1()
+{
+	quantizing_laplacian_coordinates(8);
+	initialize_tripletList_and_deltamesh();
 	BFS_Graph(first_anchor,6);
 	vesq.clear();
 	for(list<Vertex*>::iterator iv=vertices->begin(); iv != vertices->end(); iv++)
@@ -1253,10 +2847,6 @@ void Mesh::test_anchor2()
 	vector<int> anchorsize;
 	quantizing_laplacian_coordinates(5);
 	initialize_tripletList_and_deltamesh();
-	for(list<Vertex*>::iterator iv=vertices->begin(); iv != vertices->end(); iv++)	//BFS򣬰êԶĵΪê
-	{
-		ver.push_back((*iv));
-	}
 	dwStart = GetTickCount();
 	for(int i=0;i<35;i++)
 	{
@@ -1296,10 +2886,6 @@ void Mesh::test_anchor3()
 	vector<int> anchorsize;
 	quantizing_laplacian_coordinates(5);
 	initialize_tripletList_and_deltamesh();
-	for(list<Vertex*>::iterator iv=vertices->begin(); iv != vertices->end(); iv++)	//BFS򣬰êԶĵΪê
-	{
-		ver.push_back((*iv));
-	}
 	dwStart = GetTickCount();
 	BFS_Graph(first_anchor,9);
 	dwEnd = GetTickCount();
@@ -1353,6 +2939,242 @@ void Mesh::test_anchor3()
 	}*/
 }
 
+void Mesh::benchmark_solvers(FILE *f, const char *name)
+{
+	//factor/solve time and memory of every normal equation backend for the
+	//current anchors (vesq), one line per backend
+	Solver_Type types[4] = {LU_SOLVER, LDLT_SOLVER, LLT_SOLVER, CHOLMOD_SOLVER};
+	LARGE_INTEGER freq, t0, t1, t2, t3;
+	PROCESS_MEMORY_COUNTERS pmc;
+	SIZE_T before;
+	SpMatd A;
+	MatrixXf b;
+	MatrixXd x;
+	NormalSolver *solver;
+	initialize_gram();
+	assemble_anchored_system(vesq.size(), &A, &b);
+	MatrixXd bd = b.cast<double>();
+	QueryPerformanceFrequency(&freq);
+	for(int i=0;i<4;i++)
+	{
+		if(!NormalSolver::available(types[i]))
+			continue;
+		GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc));
+		before = pmc.WorkingSetSize;
+		solver = NormalSolver::create(types[i]);
+		QueryPerformanceCounter(&t0);
+		solver->analyze_pattern(&A);
+		QueryPerformanceCounter(&t1);
+		if(solver->factorize(&A))
+		{
+			fprintf(f,"%s %s factorization failed\n", name, NormalSolver::name(types[i]));
+			delete solver;
+			continue;
+		}
+		QueryPerformanceCounter(&t2);
+		solver->solve(bd, &x);
+		QueryPerformanceCounter(&t3);
+		GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc));
+		//name backend vertices anchors analyze(ms) factorize(ms) solve(ms) factor memory(MB) process peak(MB) residual
+		fprintf(f,"%s %s %d %d %.2f %.2f %.2f %.2f %.2f %g\n", name, NormalSolver::name(types[i]),
+			(int)vertices->size(), (int)vesq.size(),
+			1000.0*(t1.QuadPart-t0.QuadPart)/freq.QuadPart,
+			1000.0*(t2.QuadPart-t1.QuadPart)/freq.QuadPart,
+			1000.0*(t3.QuadPart-t2.QuadPart)/freq.QuadPart,
+			(pmc.WorkingSetSize>before ? pmc.WorkingSetSize-before : 0)/1048576.0,
+			pmc.PeakWorkingSetSize/1048576.0,
+			(A*x-bd).norm()/bd.norm());
+		delete solver;
+	}
+}
+
+void Mesh::benchmark_orderings(FILE *f, const char *name)
+{
+	//renumbers the mesh in every Vertex_Order and times L^T L assembly,
+	//analysis, factorization and solve of the anchored system of
+	//solve_anchored_system() (right-hand side from the delta coordinates
+	//quantized with the current bits, 8 if none) and 100 Laplacian
+	//products, next to the locality of the numbering; one line per order.
+	//The factorization is SimplicialLDLT without fill-reducing ordering,
+	//so it sees the vertex numbering itself. Afterwards the mesh has its
+	//old names and per-name data again
+	Vertex_Order types[4] = {FILE_ORDER, BFS_ORDER, RCM_ORDER, MORTON_ORDER};
+	LARGE_INTEGER freq, t0, t1, t2, t3, t4, t5, t6;
+	Order_Locality locality;
+	EigenNormalSolver< SimplicialLDLT<SpMatd, Lower, NaturalOrdering<int> > > solver;
+	SpMatd A;
+	MatrixXf b, product;
+	MatrixXd x;
+	int rebuild = !adjacency.empty();
+	int bits = quantization_bits > 0 ? quantization_bits : 8;
+	int k;
+
+	vector<Vertex*> old_vertices(vertices->begin(), vertices->end());
+	vector<Triangle*> old_triangles(triangles->begin(), triangles->end());
+	vector<Edge*> old_edges(edges->begin(), edges->end());
+	vector<int> vertex_numbers, triangle_numbers, edge_numbers;
+	vector<MathVector> old_lapcoor;
+	vector<Vertex*> old_vertex_names = vertex_names;
+	vector<Triangle*> old_triangle_names = triangle_names;
+	vector<Edge*> old_edge_names = edge_names;
+	int old_ver_nr = ver_nr, old_tri_nr = tri_nr, old_edge_nr = edge_nr;
+	MatrixXf old_deltamesh = deltamesh, old_gram_delta = gram_delta;
+	MatrixXf old_laplacian = laplacian_coordinates, old_quantized = quantized_coordinates;
+	MatrixXi old_indices = quantized_indices;
+	VectorXd old_mq = vertex_mq, old_sq = vertex_sq;
+	float old_min[3], old_step[3];
+	int old_bits = quantization_bits;
+	for(k=0;k<3;k++)
+	{
+		old_min[k] = quantization_min[k];
+		old_step[k] = quantization_step[k];
+	}
+	for(k=0;k<(int)old_vertices.size();k++)
+	{
+		vertex_numbers.push_back(old_vertices[k]->name);
+		old_lapcoor.push_back(old_vertices[k]->quantized_lapcoor);
+	}
+	for(k=0;k<(int)old_triangles.size();k++)
+		triangle_numbers.push_back(old_triangles[k]->name);
+	for(k=0;k<(int)old_edges.size();k++)
+		edge_numbers.push_back(old_edges[k]->name);
+
+	QueryPerformanceFrequency(&freq);
+	for(int i=0;i<4;i++)
+	{
+		reorder_vertices(types[i]);
+		if(adjacency.empty())
+			ini_ner_ver();
+		order_locality(adjacency_offset, adjacency, &locality);
+		QueryPerformanceCounter(&t0);
+		initialize_gram();
+		QueryPerformanceCounter(&t1);
+		quantizing_laplacian_coordinates(bits);
+		initialize_tripletList_and_deltamesh();
+		assemble_anchored_system(vesq.size(), &A, &b);
+		QueryPerformanceCounter(&t2);
+		solver.analyze_pattern(&A);
+		QueryPerformanceCounter(&t3);
+		if(solver.factorize(&A))
+		{
+			fprintf(f,"%s %s factorization failed\n", name, vertex_order_name(types[i]));
+			continue;
+		}
+		QueryPerformanceCounter(&t4);
+		solver.solve(b.cast<double>(), &x);
+		QueryPerformanceCounter(&t5);
+		for(int r=0;r<100;r++)
+			laplacian_transpose_product(positions, &product);
+		QueryPerformanceCounter(&t6);
+		//name order bandwidth mean_distance mean_profile miss_rate gram(ms) analyze(ms) factorize(ms) solve(ms) 100 products(ms)
+		fprintf(f,"%s %s %d %.1f %.1f %.4f %.2f %.2f %.2f %.2f %.2f\n", name, vertex_order_name(types[i]),
+			locality.bandwidth, locality.mean_distance, locality.mean_profile, locality.miss_rate,
+			1000.0*(t1.QuadPart-t0.QuadPart)/freq.QuadPart,
+			1000.0*(t3.QuadPart-t2.QuadPart)/freq.QuadPart,
+			1000.0*(t4.QuadPart-t3.QuadPart)/freq.QuadPart,
+			1000.0*(t5.QuadPart-t4.QuadPart)/freq.QuadPart,
+			1000.0*(t6.QuadPart-t5.QuadPart)/freq.QuadPart);
+	}
+
+	//the caller's lists, names and per-name data
+	vertices->assign(old_vertices.begin(), old_vertices.end());
+	triangles->assign(old_triangles.begin(), old_triangles.end());
+	edges->assign(old_edges.begin(), old_edges.end());
+	for(k=0;k<(int)old_vertices.size();k++)
+	{
+		old_vertices[k]->name = vertex_numbers[k];
+		old_vertices[k]->quantized_lapcoor = old_lapcoor[k];
+	}
+	for(k=0;k<(int)old_triangles.size();k++)
+		old_triangles[k]->name = triangle_numbers[k];
+	for(k=0;k<(int)old_edges.size();k++)
+		old_edges[k]->name = edge_numbers[k];
+	vertex_names.swap(old_vertex_names);
+	triangle_names.swap(old_triangle_names);
+	edge_names.swap(old_edge_names);
+	ver_nr = old_ver_nr;
+	tri_nr = old_tri_nr;
+	edge_nr = old_edge_nr;
+	renamed_vertices(rebuild);
+	deltamesh.swap(old_deltamesh);
+	gram_delta.swap(old_gram_delta);
+	laplacian_coordinates.swap(old_laplacian);
+	quantized_coordinates.swap(old_quantized);
+	quantized_indices.swap(old_indices);
+	vertex_mq.swap(old_mq);
+	vertex_sq.swap(old_sq);
+	quantization_bits = old_bits;
+	for(k=0;k<3;k++)
+	{
+		quantization_min[k] = old_min[k];
+		quantization_step[k] = old_step[k];
+	}
+}
+
+static void rotate_lowest_first(int *c)
+{
+	//same triangle, same orientation, smallest corner first
+	while(c[0] > c[1] || c[0] > c[2])
+	{
+		int x = c[0];
+		c[0] = c[1];
+		c[1] = c[2];
+		c[2] = x;
+	}
+}
+
+void Mesh::check_connectivity_coder(FILE *f, const char *name)
+{
+	//cut-border codes the triangles and decodes them again, the decoded
+	//triangles have to be the original ones in decoding numbers; then
+	//decodes 2000 random streams of 1 to 64 bytes with the same counts,
+	//which may only fail or give some other mesh. One line per mesh
+	int n = vertices->size(), t = triangles->size();
+	vector<unsigned char> block, garbage;
+	vector<int> order, position, indices;
+	vector< vector<int> > original, decoded;
+	int i, k, roundtrip, accepted = 0;
+	if(t == 0 || encode_connectivity(triangles, n, &block, &order))
+	{
+		fprintf(f,"%s not cut-border codable\n", name);
+		return;
+	}
+	position.resize(n);
+	for(i=0;i<n;i++)
+		position[order[i]] = i;
+	for(list<Triangle*>::iterator it=triangles->begin(); it != triangles->end(); it++)
+	{
+		int c[3];
+		for(k=0;k<3;k++)
+			c[k] = position[(*it)->vertices[k]->name-1];
+		rotate_lowest_first(c);
+		original.push_back(vector<int>(c, c+3));
+	}
+	roundtrip = decode_connectivity(&block[0], block.size(), n, t, &indices) == (int)block.size();
+	if(roundtrip)
+	{
+		for(i=0;i<t;i++)
+		{
+			rotate_lowest_first(&indices[3*i]);
+			decoded.push_back(vector<int>(indices.begin()+3*i, indices.begin()+3*i+3));
+		}
+		sort(original.begin(), original.end());
+		sort(decoded.begin(), decoded.end());
+		roundtrip = original == decoded;
+	}
+	srand(1);
+	for(i=0;i<2000;i++)
+	{
+		garbage.resize(1 + rand()%64);
+		for(k=0;k<(int)garbage.size();k++)
+			garbage[k] = rand();
+		if(decode_connectivity(&garbage[0], garbage.size(), n, t, &indices) >= 0)
+			accepted++;
+	}
+	//name triangles bytes round_trip garbage_accepted
+	fprintf(f,"%s %d %d %s %d/2000\n", name, t, (int)block.size(), roundtrip ? "ok" : "FAILED", accepted);
+}
+
 void Mesh::statistics_data(FILE *f,int bit)
 {
 	int anchor[1] = {60};//ê//5,10,15,20,25,30,35,40,45,50,55,60  10,20,30,40,50,60,70,80,90
@@ -1406,162 +3228,303 @@ void Mesh::statistics_data(FILE *f,int bit)
 
 void Mesh::hausdorff_distance_1()
 {
-	Vertex *current_ver;
-	Vertex *V;
-	double temp;
-	double foreminer;
-	double backminer;
-	double maxest = -1;
-	for(list<Vertex*>::iterator iv=vertices->begin(); iv != vertices->end(); iv++)
-	{
-		current_ver = (*iv);
-		foreminer = MathVector::length(current_ver->math_data(),current_ver->math_newdata());
-		for(list<Vertex*>::iterator ivv = current_ver->neighborvertex.begin(); ivv != current_ver->neighborvertex.end();ivv++)
-		{
-			temp = MathVector::length(current_ver->math_newdata(),(*ivv)->math_data());
-			if(foreminer > temp)
-				foreminer = temp;
-		}
-		if(maxest < foreminer)
-		{
-			maxest = foreminer;
-			V = current_ver;
-		}
-	}
-	//cout<<"hausdorff distance: "<<maxest<<endl;
-	cevis.push_back(maxest);
-	//double dtemp;
-	//double ddd = 10;
-	//MathVector c;
-	//c.set(V->math_newdata());
-	//c.sub(V->math_data());
-	//cout<<"c length: "<<c.length()<<endl;
-	//for(list<Triangle*>::iterator it = V->get_triangles()->begin(); it != V->get_triangles()->end(); it++)
-	//{
-	//	dtemp = abs(MathVector::dot_product((*it)->get_surface_normal(),&c))/(*it)->get_surface_normal()->length();
-	//	cout<<"dtemp: "<<dtemp<<endl;
-	//	if(ddd > dtemp)
-	//		ddd = dtemp;
-	//}
-	//cout<<"ddd: "<<ddd<<endl;
+	Surface_Distance d;
+	surface_distance(&d);
+	cevis.push_back(d.hausdorff);
 }
 
 void Mesh::Hausdorff_distance()
 {
-	Triangle* current_tri;
-	double temp;
-	double miner;
-	double forward_maxer;
-	double backward_maxer;
-	double hausdorff =0;
-	double hausdorffback = 0;
-	double the_maxest_forward = -1;
-	double the_maxest_backward = -1;
+	Surface_Distance d;
+	VectorXd forward, backward;
+	surface_distances(&forward, &backward);
+	summarize_distances(forward, backward, &d);
+	//per-vertex distances, original to reconstructed and back
 	fstream of("documents\\hausdorff distance.txt",ios::out);
 	of.seekp(ios::beg);
-	for(list<Triangle*>::iterator it = triangles->begin();it != triangles->end();it++)
+	for(int i=0;i<positions.rows();i++)
+		of<<forward(i)<<" "<<backward(i)<<endl;
+	of.close();
+	cout<<"the_maxest_forward: "<<d.forward_max<<endl;
+	cout<<"the_maxest_backward "<<d.backward_max<<endl;
+	cout<<"forward distance mean: "<<d.forward_mean<<endl;
+	cout<<"backward distance mean: "<<d.backward_mean<<endl;
+	cout<<"hausdorff distance: "<<d.hausdorff<<" rms: "<<d.rms<<endl;
+}
+
+void Mesh::set_distance_samples(int samples)
+{
+	distance_samples = samples < 0 ? 0 : samples;
+}
+
+void Mesh::surface_distance(Surface_Distance *result)
+{
+	VectorXd forward, backward;
+	surface_distances(&forward, &backward);
+	summarize_distances(forward, backward, result);
+}
+
+void Mesh::surface_distances(VectorXd *forward, VectorXd *backward)
+{
+	//forward: points of the original surface (positions) against the
+	//reconstructed one (new_positions), backward the other way round;
+	//both share triangle_indices, so one set of samples, weighted by the
+	//original areas, serves both directions
+	TriangleBVH reconstructed;
+	MatrixXf barycentric, points;
+	vector<int> sampled;
+	VectorXd extra;
+	int n = positions.rows();
+	if(!original_surface_valid)
+	{
+		original_surface.build(positions, triangle_indices);
+		original_surface_valid = 1;
+	}
+	reconstructed.build(new_positions, triangle_indices);
+	reconstructed.distances(positions, forward);
+	original_surface.distances(new_positions, backward);
+	if(distance_samples > 0)
+	{
+		sample_surface(positions, triangle_indices, distance_samples, &barycentric, &sampled);
+		place_samples(positions, triangle_indices, barycentric, sampled, &points);
+		reconstructed.distances(points, &extra);
+		forward->conservativeResize(n + extra.size());
+		forward->tail(extra.size()) = extra;
+		place_samples(new_positions, triangle_indices, barycentric, sampled, &points);
+		original_surface.distances(points, &extra);
+		backward->conservativeResize(n + extra.size());
+		backward->tail(extra.size()) = extra;
+	}
+}
+
+void Mesh::visual_quality_measure_for_greedy()
+{
+	Quality_Terms terms;
+	quality_terms(&terms);
+	//no vertex when every Mq is NaN
+	if(terms.max_vertex >= 0)
+		vesq.push_back(vertex_index[terms.max_vertex]);
+}
+
+void Mesh::set_greedy_batch(int batch, int separation, float band, float tolerance)
+{
+	greedy_batch = batch < 1 ? 1 : batch;
+	greedy_separation = separation;
+	greedy_band = band;
+	greedy_tolerance = tolerance;
+	greedy_round = greedy_batch;
+	greedy_round_floor = 0;
+}
+
+int Mesh::select_greedy_anchors(int m)
+{
+	//appends up to m anchors with the largest Mq; each has Mq within
+	//greedy_band of the maximum and lies at least greedy_separation
+	//edges away from the others picked in this round.
+	//One anchor at a time, the largest Mq left after k more anchors is
+	//about the Mq of the k-th of them. If the maximum after a batched
+	//round lies more than greedy_tolerance above the smallest Mq picked
+	//in it, the batch fell short of that: the rounds are halved, down to
+	//the one-at-a-time greedy. Returns 0 if no vertex has a finite Mq
+	int n = vertex_index.size();
+	int picked = 0;
+	int i, d, k;
+	double maxerror = 0;
+	vector< pair<double,int> > candidates;
+	vector<int> blocked(n,0);
+	queue< pair<int,int> > q;
+	if(greedy_round > 1 || greedy_round_floor > 0)
 	{
-		current_tri = (*it);
-		forward_maxer = -1;
-		for(int i=0;i<3;i++)	//ֵ
+		squared_errors(&vertex_mq);
+		maxerror = vertex_mq.maxCoeff();
+		if(greedy_round_floor > 0 && maxerror > (1+greedy_tolerance)*greedy_round_floor)
+			greedy_round /= 2;
+	}
+	greedy_round_floor = 0;
+	if(m > greedy_round)
+		m = greedy_round;
+	if(m <= 1)
+	{
+		k = vesq.size();
+		visual_quality_measure_for_greedy();
+		return vesq.size() - k;
+	}
+	for(i=0;i<n;i++)
+	{
+		if(vertex_mq(i) >= (1-greedy_band)*maxerror)
+			candidates.push_back(make_pair(-vertex_mq(i),i));
+	}
+	//largest error first, ties in index order as the one-at-a-time greedy
+	sort(candidates.begin(),candidates.end());
+	for(vector< pair<double,int> >::size_type st=0;st<candidates.size()&&picked<m;st++)
+	{
+		Vertex *v = vertex_index[candidates[st].second];
+		if(blocked[v->name-1])
+			continue;
+		vesq.push_back(v);
+		picked++;
+		//block the ball of radius separation-1 around the new anchor
+		blocked[v->name-1] = 1;
+		q.push(make_pair(v->name-1,1));
+		while(!q.empty())
 		{
-			miner = 100;
-			for(int j=0;j<3;j++)	//Сֵ
+			i = q.front().first;
+			d = q.front().second;
+			q.pop();
+			if(d >= greedy_separation)
+				continue;
+			for(k=adjacency_offset[i];k<adjacency_offset[i+1];k++)
 			{
-				temp = MathVector::length(current_tri->vertices[i]->math_data(),current_tri->vertices[j]->math_newdata());
-				if(miner > temp)
+				if(!blocked[adjacency[k]])
 				{
-					miner = temp;
+					blocked[adjacency[k]] = 1;
+					q.push(make_pair(adjacency[k],d+1));
 				}
 			}
-			if(forward_maxer < miner)
-			{
-				forward_maxer = miner;
-			}
 		}
-		//......................................................
-		backward_maxer = -1;
-		for(int i=0;i<3;i++)	//ֵ
+	}
+	if(picked > 1)
+		greedy_round_floor = vertex_mq(vesq.back()->name-1);
+	return picked;
+}
+
+void Mesh::squared_errors(VectorXd *mq) const
+{
+	//|p - p'|^2 per vertex, streamed over the position columns
+	int n = positions.rows();
+	float d;
+	*mq = VectorXd::Zero(n);
+	for(int c=0;c<3;c++)
+	{
+		const float *p = positions.col(c).data();
+		const float *pn = new_positions.col(c).data();
+		double *e = mq->data();
+		for(int i=0;i<n;i++)
 		{
-			miner = 100;
-			for(int j=0;j<3;j++)	//Сֵ
-			{
-				temp = MathVector::length(current_tri->vertices[i]->math_newdata(),current_tri->vertices[j]->math_data());
-				if(miner > temp)
-				{
-					miner = temp;
-				}
-			}
-			if(backward_maxer < miner)
-			{
-				backward_maxer = miner;
-			}
+			d = p[i] - pn[i];
+			e[i] += (double)d*d;
 		}
-		of<<forward_maxer<<" "<<backward_maxer<<endl;
-		if(the_maxest_forward < forward_maxer)
-			the_maxest_forward = forward_maxer;
-		if(the_maxest_backward < backward_maxer)
-			the_maxest_backward = backward_maxer;
-		hausdorff += forward_maxer;
-		hausdorffback += backward_maxer;
 	}
-	of.close();
-	cout<<"the_maxest_forward: "<<the_maxest_forward<<endl;
-	cout<<"the_maxest_backward "<<the_maxest_backward<<endl;
-	cout<<"forward distance mean: "<<hausdorff/triangles->size()<<endl;
-	cout<<"backward distance mean: "<<hausdorffback/triangles->size()<<endl;
 }
 
-void Mesh::visual_quality_measure_for_greedy()
+void Mesh::update_original_laplacian(void)
 {
-	double Mq = 0;
-	double Sq = 0;
-	double temp;
-	double maxerror = -100;
-	Vertex* current_v;
-
-	for(list<Vertex*>::iterator iv=vertices->begin(); iv != vertices->end(); iv++)
+	//the original side of Vertex::geometric_laplacian() with the same arithmetic
+	int n = positions.rows();
+	int i;
+	if(original_laplacian.rows() == n)
+		return;
+	original_laplacian.resize(n,3);
+#pragma omp parallel for
+	for(i=0;i<n;i++)
 	{
-		temp = MathVector::length2((*iv)->math_data(),(*iv)->math_newdata());
-		(*iv)->Mq = temp;
-
-		temp = (*iv)->geometric_laplacian();
-		(*iv)->Sq = temp;
+		Vector3f p = positions.row(i);
+		Vector3f w, sum;
+		float l;
+		float sl = 0;
+		sum.setZero();
+		for(int k=adjacency_offset[i];k<adjacency_offset[i+1];k++)
+		{
+			w = positions.row(adjacency[k]);
+			l = 1.0/sqrt((double)(w-p).squaredNorm());
+			sl += l;
+			sum += w*l;
+		}
+		original_laplacian.row(i) = p - sum/sl;
+	}
+}
 
+void Mesh::quality_terms(Quality_Terms *terms)
+{
+	//Mq = |p - p'|^2 and Sq = Vertex::geometric_laplacian() of every vertex in one
+	//pass, stored into vertex_mq and vertex_sq; the original side comes
+	//from original_laplacian. One range of vertices per thread, the partial
+	//sums are added in range order and the first maximum is kept
+	int n = vertex_index.size();
+	int chunks, c;
+	update_original_laplacian();
+#ifdef _OPENMP
+	chunks = omp_get_max_threads();
+#else
+	chunks = 1;
+#endif
+	vector<double> mq_sum(chunks,0), sq_sum(chunks,0), max_mq(chunks,-1);
+	vector<int> max_vertex(chunks,-1);
+	vertex_mq.resize(n);
+	vertex_sq.resize(n);
+	const float *px = positions.col(0).data();
+	const float *py = positions.col(1).data();
+	const float *pz = positions.col(2).data();
+	const float *nx = new_positions.col(0).data();
+	const float *ny = new_positions.col(1).data();
+	const float *nz = new_positions.col(2).data();
+#pragma omp parallel for
+	for(c=0;c<chunks;c++)
+	{
+		int first = (int)((__int64)n*c/chunks);
+		int last = (int)((__int64)n*(c+1)/chunks);
+		Vector3f pn, w, sumn;
+		float d, l, sln;
+		double mq, sq;
+		for(int i=first;i<last;i++)
+		{
+			d = px[i]-nx[i];
+			mq = (double)d*d;
+			d = py[i]-ny[i];
+			mq += (double)d*d;
+			d = pz[i]-nz[i];
+			mq += (double)d*d;
+
+			pn << nx[i], ny[i], nz[i];
+			sumn.setZero();
+			sln = 0;
+			for(int k=adjacency_offset[i];k<adjacency_offset[i+1];k++)
+			{
+				int j = adjacency[k];
+				w << nx[j], ny[j], nz[j];
+				l = 1.0/sqrt((double)(w-pn).squaredNorm());
+				sln += l;
+				sumn += w*l;
+			}
+			sumn = pn - sumn/sln;
+			sq = (original_laplacian.row(i).transpose()-sumn).cast<double>().squaredNorm();
+
+			vertex_mq(i) = mq;
+			vertex_sq(i) = sq;
+			mq_sum[c] += mq;
+			sq_sum[c] += sq;
+			if(mq > max_mq[c])
+			{
+				max_mq[c] = mq;
+				max_vertex[c] = i;
+			}
+		}
 	}
-	for(list<Vertex*>::iterator iv=vertices->begin(); iv != vertices->end(); iv++)
+	terms->Mq = 0;
+	terms->Sq = 0;
+	terms->max_mq = -1;
+	terms->max_vertex = -1;
+	for(c=0;c<chunks;c++)
 	{
-		temp = (*iv)->Mq;
-		if(temp>maxerror)
+		terms->Mq += mq_sum[c];
+		terms->Sq += sq_sum[c];
+		if(max_mq[c] > terms->max_mq)
 		{
-			maxerror = temp;
-			current_v = (*iv);
+			terms->max_mq = max_mq[c];
+			terms->max_vertex = max_vertex[c];
 		}
 	}
-	vesq.push_back(current_v);
 }
 
 double Mesh::visual_quality_measure(float a)
 {
-	double Mq = 0;
-	double Sq = 0;
-	double temp;
+	double Mq;
+	double Sq;
 	double Evis;
-	double maxerror = -100;
-	Vertex* current_v;
-	for(list<Vertex*>::iterator iv=vertices->begin(); iv != vertices->end(); iv++)
-	{
-		temp = MathVector::length2((*iv)->math_data(),(*iv)->math_newdata());
-		(*iv)->Mq = temp;
-		Mq += temp;
-
-		temp = (*iv)->geometric_laplacian();
-		(*iv)->Sq = temp;
-		Sq += temp;
-
-	}
-	Mq = sqrt(Mq);
-	Sq = sqrt(Sq);
+	Quality_Terms terms;
+	quality_terms(&terms);
+	Mq = sqrt(terms.Mq);
+	Sq = sqrt(terms.Sq);
 	cevis.push_back(Mq);
 	cevis.push_back(Sq);
 	Evis = a*Mq + (1-a)*Sq;
@@ -1651,12 +3614,7 @@ void Mesh::solve_invertible_linear_equations()
 	Eigen::SimplicialCholesky<SpMat> chol(slaplacian);  // performs a Cholesky factorization of A
 	MatrixXf result = chol.solve(delta);
 
-	for(list<Vertex*>::iterator iv=vertices->begin(); iv != vertices->end(); iv++)
-	{
-		(*iv)->newdata.v[0] = (result.col(0))((*iv)->name-1);
-		(*iv)->newdata.v[1] = (result.col(1))((*iv)->name-1);
-		(*iv)->newdata.v[2] = (result.col(2))((*iv)->name-1);
-	}
+	store_reconstruction(result);
 }
 
 
@@ -1687,12 +3645,7 @@ void Mesh::solve_sparse_linear_equations()
 	MatrixXf result = chol.solve(delta);
 	
 	//ֵ
-	for(list<Vertex*>::iterator iv=vertices->begin(); iv != vertices->end(); iv++)
-	{
-		(*iv)->newdata.v[0] = (result.col(0))((*iv)->name-1);
-		(*iv)->newdata.v[1] = (result.col(1))((*iv)->name-1);
-		(*iv)->newdata.v[2] = (result.col(2))((*iv)->name-1);
-	}
+	store_reconstruction(result);
 
 	//move
 	mymove_to_centre();
@@ -2003,42 +3956,18 @@ void Mesh::solving_least_squares(int anchor)
 	vector<Vertex*> seedsq;
 	list<Vertex*>::iterator looking;
 	int color_emum[8][3]={{255,97,0},{127,255,0},{218,112,214},{128,42,42},{8,46,84},{255,99,71},{65,105,225},{48,128,20}};
-	typedef Eigen::Triplet<float> T;
-	std::vector<T> tripletList;
-	SpMat slaplacian((vertices->size()+anchor),vertices->size());
-	MatrixXf delta = MatrixXf::Zero(vertices->size()+anchor,3);
-	Vertex* current_vertex;
-	int i,j;
-	int row=0;
+	MatrixXf delta = MatrixXf::Zero(vertices->size(),3);
+	int i;
 	cout<<"anchor: "<<anchor<<endl;
 	for(list<Vertex*>::iterator iv=vertices->begin(); iv != vertices->end(); iv++)
 	{
 		i = (*iv)->name-1;
-		tripletList.push_back(T(i, i, (*iv)->neighborvertex.size()));
 		for(int ii=0;ii<3;ii++)
 		{
-			delta(row,ii)=((*iv)->math_quantized_lapcoor()->v[ii])*(*iv)->neighborvertex.size();
-		}
-		for(list<Vertex*>::iterator ivv=((*iv)->neighborvertex).begin();ivv!=((*iv)->neighborvertex).end();ivv++)
-		{
-			j = (*ivv)->name-1;
-			tripletList.push_back(T(i, j, -1.0));
-		}
-		row++;
-	}
-	int appended = vertices->size();
-	for(vector<Vertex*>::size_type st=0;st<anchor;st++)
-	{
-		j = vesq[st]->name-1;
-		tripletList.push_back(T(appended++, j, 1));
-		for(int i=0;i<3;i++)
-		{
-			delta(row,i)=vesq[st]->math_data()->v[i];
+			delta(i,ii)=((*iv)->math_quantized_lapcoor()->v[ii])*(*iv)->neighborvertex.size();
 		}
-		row++;
 	}
-
-	slaplacian.setFromTriplets(tripletList.begin(), tripletList.end());
+	laplacian_transpose_product(delta, &gram_delta);
 
 	// Solving:
 	//SparseQR<SparseMatrix<float>, COLAMDOrdering<int> > qr(slaplacian);
@@ -2050,18 +3979,11 @@ void Mesh::solving_least_squares(int anchor)
 	//qr.factorize(slaplacian);*/
 	//MatrixXf result = L.solve(b);
 
-	SpMat A = slaplacian.transpose()*slaplacian;
-	SparseLU<SparseMatrix<float>, COLAMDOrdering<int> > lu;
-	lu.analyzePattern(A);
-	lu.factorize(A);
-	MatrixXf deltaa = slaplacian.transpose()*delta;
-	MatrixXf result = lu.solve(deltaa);
+	MatrixXf result;
+	solve_anchored_system(anchor, &result);
+	store_reconstruction(result);
 	for(list<Vertex*>::iterator iv=vertices->begin(); iv != vertices->end(); iv++)
 	{
-		(*iv)->newdata.v[0] = (result.col(0))((*iv)->name-1);
-		(*iv)->newdata.v[1] = (result.col(1))((*iv)->name-1);
-		(*iv)->newdata.v[2] = (result.col(2))((*iv)->name-1);
-
 		(*iv)->color[0] = color_emum[0][0];
 		(*iv)->color[1] = color_emum[0][1];
 		(*iv)->color[2] = color_emum[0][2];
@@ -2076,18 +3998,15 @@ void Mesh::solving_least_squares(int anchor)
 }
 void Mesh::block_least_square(int bit,int anchor)
 {
-	MathVector c;
-	int count=0;
-	int row;
 	typedef Eigen::Triplet<float> T;
-	std::vector<T> tripletList;
-	vector<Vertex*> seedsq;
-	int color =0;
+	int parts = superlist.size();
 	int color_emum[8][3]={{255,97,0},{127,255,0},{218,112,214},{128,42,42},{8,46,84},{255,99,71},{65,105,225},{48,128,20}};//ɫ ɫ ɫ ɫ  ެѺ Ʒ ɫ
-	list<Vertex*> *part_list;
-	for(vector<list<Vertex*>>::size_type liv = 0; liv != superlist.size();liv++)//ÿһls
+#pragma omp parallel for
+	for(int liv=0;liv<parts;liv++)//ÿһls
 	{
-		part_list = &superlist[liv];
+		list<Vertex*> *part_list = &superlist[liv];
+		MathVector c;
+		int count=0;
 		for(list<Vertex*>::iterator it = part_list->begin(); it != part_list->end(); it++)
 		{
 			for(list<Vertex*>::iterator ivv=((*it)->segmented_neighborvertex).begin();ivv!=((*it)->segmented_neighborvertex).end();ivv++)
@@ -2126,63 +4045,77 @@ void Mesh::block_least_square(int bit,int anchor)
 		}
 	}
 
-	for(vector<list<Vertex*>>::size_type liv = 0; liv != superlist.size();liv++)//ÿһ
+	//every partition is assembled, factored and solved on its own. The
+	//partitions are disjoint, so they run in parallel; each thread keeps
+	//its triplet list, anchor list and right-hand side between the
+	//partitions it takes
+#pragma omp parallel
 	{
-		printf("delta...\n");
-		part_list = &superlist[liv];
-		MatrixXf delta = MatrixXf::Zero(part_list->size()+anchor,3);
-		SpMat slaplacian(part_list->size()+anchor,part_list->size());
-		int i,j;
-		tripletList.clear();
-		for(list<Vertex*>::iterator it = part_list->begin(); it != part_list->end(); it++)
+		vector<T> triplets;
+		vector<Vertex*> seedsq;
+		MatrixXf delta, result;
+#pragma omp for schedule(dynamic)
+		for(int liv=0;liv<parts;liv++)
 		{
-			i = (*it)->blockid-1;
-			tripletList.push_back(T(i, i, (*it)->segmented_neighborvertex.size()));
-			for(int ii=0;ii<3;ii++)
+			list<Vertex*> *part_list = &superlist[liv];
+			int size = part_list->size();
+			int i, j, appended, anchors;
+			seedsq.clear();
+			for(list<Vertex*>::iterator it = part_list->begin(); it != part_list->end(); it++)
 			{
-				delta((*it)->blockid-1,ii) = (*it)->math_quantized_lapcoor()->v[ii]*(*it)->segmented_neighborvertex.size();
+				if((*it)->dye==0)
+					seedsq.push_back((*it));
 			}
-			for(list<Vertex*>::iterator ivv=((*it)->segmented_neighborvertex).begin();ivv!=((*it)->segmented_neighborvertex).end();ivv++)
+			anchors = min(anchor, (int)seedsq.size());
+			delta.setZero(size+anchors,3);
+			triplets.clear();
+			for(list<Vertex*>::iterator it = part_list->begin(); it != part_list->end(); it++)
 			{
-				j = (*ivv)->blockid-1;
-				tripletList.push_back(T(i, j, -1.0));
+				i = (*it)->blockid-1;
+				triplets.push_back(T(i, i, (*it)->segmented_neighborvertex.size()));
+				for(int ii=0;ii<3;ii++)
+				{
+					delta(i,ii) = (*it)->math_quantized_lapcoor()->v[ii]*(*it)->segmented_neighborvertex.size();
+				}
+				for(list<Vertex*>::iterator ivv=((*it)->segmented_neighborvertex).begin();ivv!=((*it)->segmented_neighborvertex).end();ivv++)
+				{
+					j = (*ivv)->blockid-1;
+					triplets.push_back(T(i, j, -1.0));
+				}
 			}
-			if((*it)->dye==0)
-				seedsq.push_back((*it));
-		}
-		slaplacian.setFromTriplets(tripletList.begin(), tripletList.end());
-		
-		int appended = part_list->size();
-		for(vector<Vertex*>::size_type st=0;st<anchor;st++)
-		{
-			j = seedsq[st]->blockid-1;
-			tripletList.push_back(T(appended, j, 1));
-			for(int i=0;i<3;i++)
+			//anchor rows go in before the matrix is built
+			appended = size;
+			for(int st=0;st<anchors;st++)
 			{
-				delta(appended,i)=seedsq[st]->math_data()->v[i];
+				j = seedsq[st]->blockid-1;
+				triplets.push_back(T(appended, j, 1));
+				for(int ii=0;ii<3;ii++)
+				{
+					delta(appended,ii)=seedsq[st]->math_data()->v[ii];
+				}
+				appended++;
+			}
+			SpMat slaplacian(size+anchors,size);
+			slaplacian.setFromTriplets(triplets.begin(), triplets.end());
+			// Solving:
+			SparseQR<SparseMatrix<float>, COLAMDOrdering<int> > qr;
+			qr.analyzePattern(slaplacian);
+			qr.factorize(slaplacian);
+			result = qr.solve(delta);
+			//ֵ
+			for(list<Vertex*>::iterator it = part_list->begin(); it != part_list->end(); it++)
+			{
+				i = (*it)->blockid-1;
+				(*it)->newdata.v[0] = result(i,0);
+				(*it)->newdata.v[1] = result(i,1);
+				(*it)->newdata.v[2] = result(i,2);
+				(*it)->color[0] = color_emum[liv%8][0];
+				(*it)->color[1] = color_emum[liv%8][1];
+				(*it)->color[2] = color_emum[liv%8][2];
 			}
-			appended++;
-		}
-		seedsq.clear();
-		// Solving:
-		SparseQR<SparseMatrix<float>, COLAMDOrdering<int> > qr;
-		/*qr.compute(slaplacian);*/
-		qr.analyzePattern(slaplacian);
-		qr.factorize(slaplacian);
-		MatrixXf result = qr.solve(delta);
-		//ֵ
-		for(list<Vertex*>::iterator it = part_list->begin(); it != part_list->end(); it++)
-		{
-
-			(*it)->newdata.v[0] = (result.col(0))((*it)->blockid-1);
-			(*it)->newdata.v[1] = (result.col(1))((*it)->blockid-1);
-			(*it)->newdata.v[2] = (result.col(2))((*it)->blockid-1);
-			(*it)->color[0] = color_emum[color%8][0];
-			(*it)->color[1] = color_emum[color%8][1];
-			(*it)->color[2] = color_emum[color%8][2];
 		}
-		color++;
 	}
+	gather_positions();
 }
 
 void Mesh::compute_vertex_curvature()
@@ -22,6 +22,14 @@
 #include "triangle.h"
 #include "edge.h"
 #include "vertex.h"
+#include "pool.h"
+#include "kd_tree.h"
+#include "triangle_bvh.h"
+#include "range_coder.h"
+#include "connectivity_coder.h"
+#include "vertex_order.h"
+#include "anchor_solver.h"
+#include "schwarz_solver.h"
 #include <time.h>
 #include <iostream>  
 #include <Eigen/Dense> 
@@ -47,6 +55,15 @@ string convertToString(int x);
 bool Sqlarge(const Vertex* v1, const Vertex* v2);
 typedef Eigen::Triplet<float> T;
 
+//sums of the per-vertex Mq and Sq of one metric pass, and the vertex
+//(name-1) with the largest Mq, the first one on ties
+typedef struct
+{
+	double Mq, Sq;
+	double max_mq;
+	int max_vertex;
+} Quality_Terms;
+
 class Mesh
 {
 public:
@@ -65,6 +82,16 @@ public:
   void add_edges(list<Edge*> *new_edges, int clear_map = TRUE);
   void add_vertices(list<Vertex*> *new_vertices);
 
+  // primitives stored in the mesh's pools; they are freed by remove()
+  // and clear() like the ones passed in from the heap
+  Vertex* new_vertex(float x, float y, float z);
+  Edge* new_edge(Vertex *v1, Vertex *v2);
+  Triangle* new_triangle(Vertex *v1, Vertex *v2, Vertex *v3);
+  Shape* new_shape(list<Triangle*> *tri, list<Vertex*> *ver,
+		   const char *text_name = "");
+  Shape* new_shape(list<Edge*> *edg, list<Vertex*> *ver);
+  Shape* new_shape(list<Vertex*> *ver);
+
   void remove(Vertex *v);
   void remove(Edge *e);
   void remove(Triangle *t);
@@ -106,9 +133,16 @@ public:
   void calc_original_coordinates(const Vertex *v, Vertex *org) const;
 
   void negate_surface_normals(void);
-  void remove_double_points(void);
+  // welds vertices closer than tolerance (0: equal positions)
+  void remove_double_points(float tolerance = 0.0);
+  // renumbers vertices, triangles and edges for locality, see
+  // vertex_order.h; meant right after loading
+  void reorder_vertices(Vertex_Order type);
 
   Vertex* find_closed_point(const Vertex *v) const;
+  // nearest vertex to each row of points (n x 3), in parallel
+  void find_closed_points(const MatrixXf &points,
+			  vector<Vertex*> *result) const;
 
   void clear_selection(void);
   Vertex* select_vertex(unsigned int name);
@@ -117,6 +151,17 @@ public:
   //xbb
 	void initialize_delta(void);
 	void ini_ner_ver(void);
+	void build_adjacency(void);
+	int degree(int i) const;
+	const int* neighbors_begin(int i) const;
+	const int* neighbors_end(int i) const;
+	Vertex* vertex_at(int i) const;
+	void squared_errors(VectorXd *mq) const;
+	void update_original_laplacian(void);
+	void quality_terms(Quality_Terms *terms);
+	void build_index_buffer(void);
+	void gather_positions(void);
+	void store_reconstruction(const MatrixXf &result);
 	void solve_invertible_linear_equations(void);
 	void solve_sparse_linear_equations(void);
 	void lookfor_seeds(int num);
@@ -130,17 +175,40 @@ public:
 	void compute_vertex_curvature(void);
 	void compute_vertex_square_devaition_angle(void);
 	void quantizing_laplacian_coordinates(int bit);
+	int encode_quantized_laplacian(vector<unsigned char> *out, const vector<int> *order = NULL) const;
+	int decode_quantized_laplacian(const unsigned char *data, int size);
+	int write_compressed(FILE *f);
+	int read_compressed(FILE *f);
 	double visual_quality_measure(float a);
 	void visual_quality_measure_for_greedy(void);
+	int select_greedy_anchors(int m);
+	void set_greedy_batch(int batch, int separation, float band, float tolerance);
 	void Hausdorff_distance(void);
 	void hausdorff_distance_1(void);
+	void set_distance_samples(int samples);
+	void surface_distance(Surface_Distance *result);
+	void surface_distances(VectorXd *forward, VectorXd *backward);
 	void initialize_tripletList_and_deltamesh(void);
-	void iterator_soving_least_square(int anchor);
+	void initialize_gram(void);
+	void laplacian_transpose_product(const MatrixXf &d, MatrixXf *result) const;
+	void assemble_anchored_system(int anchor, SpMatd *A, MatrixXf *b) const;
+	void set_solver_type(Solver_Type type);
+	int solve_anchored_system(int anchor, MatrixXf *result);
+	void set_pcg_tolerance(float tolerance, int max_iterations);
+	void apply_anchored_operator(const VectorXd &weight, const MatrixXd &x, MatrixXd *y) const;
+	int pcg_solve_anchored_system(int anchor, MatrixXf *result);
+	void set_schwarz_overlap(int rings);
+	int schwarz_solve_anchored_system(int anchor, MatrixXf *result);
+	void benchmark_solvers(FILE *f, const char *name);
+	void benchmark_orderings(FILE *f, const char *name);
+	void check_connectivity_coder(FILE *f, const char *name);
+	int iterator_soving_least_square(int anchor);
 	void iterator_compute_number(int num);
 	void replace_better_anchor(FILE *f,int num);
 	void statistics_data(FILE *f,int bit);
 	void ccccc(void);
 	void test_anchor(int bit, fstream &fs, string &ss);
+	void test_anchor_sweep(int first_bit, int last_bit, fstream &fs, string &ss);
 	void test_anchor1(void);
 	void test_anchor2(void);
 	void test_anchor3(void);
@@ -155,15 +223,42 @@ public:
 	list<Vertex*> *li;
 	vector<list<Vertex*>*> supervector;
 	vector<Vertex*> vesq;
-	vector<T> tripletList;
+	SpMatR gram;	//L^T L of the uniform Laplacian, row-major; built by
+			//initialize_gram() for the direct and Schwarz solves only
+	MatrixXf gram_delta;	//L^T deltamesh
+	//structure-of-arrays copies of the per-vertex numbers, row name-1 (zero
+	//for names that remove() left unused) and one contiguous column per
+	//axis; solves write new_positions through store_reconstruction(),
+	//which also updates Vertex::newdata. Code that edits Vertex::data or
+	//newdata directly calls gather_positions().
+	MatrixXf positions;
+	MatrixXf new_positions;
+	//original-side term p - sum(w p_j)/sum(w) of Vertex::geometric_laplacian(),
+	//row name-1; fixed between solves, emptied when positions or the
+	//adjacency change and rebuilt by update_original_laplacian()
+	MatrixXf original_laplacian;
+	//per-vertex Mq and Sq of the last metric pass, row name-1
+	VectorXd vertex_mq;
+	VectorXd vertex_sq;
+	MatrixXf laplacian_coordinates;
+	MatrixXf quantized_coordinates;
+	//quantized_coordinates(i,c) = quantized_indices(i,c)*quantization_step[c]
+	//+ quantization_min[c] with 0 <= index <= 2^quantization_bits
+	MatrixXi quantized_indices;
+	float quantization_min[3];
+	float quantization_step[3];
+	int quantization_bits;
+	vector<int> triangle_indices;	//three vertex indices per triangle
 	double the_min;
 	Vertex* first_anchor;
 	vector<double> cevis;
-	vector<Vertex*> ver;
 protected:
-  // helper function for createEdges
-  Edge* get_edge(map< pair<Vertex*,Vertex*>, Edge* > *edge_map, 
-		 Vertex *v1, Vertex *v2);
+  // vertex and face lines of write() and PLY_Mesh::write()
+  void write_ply_records(FILE *f);
+  // quantization parameters, with the indices already in quantized_indices
+  void set_quantization(int bits, const float *qmin, const float *qstep);
+  // reorder_vertices() tail, once the vertices have their new names
+  void renamed_vertices(int rebuild);
 
   // data
   vector<Shape*> *shapes;
@@ -171,12 +266,71 @@ protected:
   list<Edge*> *edges;
   list<Vertex*> *vertices;
   int ver_nr, tri_nr, edge_nr;
-	
+
+  // storage of the primitives made by new_vertex() etc.
+  Pool<Shape> shape_pool;
+  Pool<Triangle> triangle_pool;
+  Pool<Edge> edge_pool;
+  Pool<Vertex> vertex_pool;
+
+  // entry name-1 is the element of that name, NULL once removed
+  vector<Triangle*> triangle_names;
+  vector<Edge*> edge_names;
+  vector<Vertex*> vertex_names;
+
+  // k-d tree of the vertex positions for find_closed_point(), built on
+  // demand; anything that adds, removes or moves vertices resets it
+  mutable KdTree vertex_tree;
+  mutable int vertex_tree_valid;
 
   // a map to avoid adding vertices more than once
   // in add_triangles() & add_edges()
   map<Vertex*, Vertex*> vertex_map;
 
+  // CSR copy of the neighborvertex lists, built by ini_ner_ver(): the
+  // neighbors of vertex i (name-1) are adjacency[adjacency_offset[i] ..
+  // adjacency_offset[i+1]-1], vertex_index[i] is the vertex itself
+  vector<int> adjacency_offset;
+  vector<int> adjacency;
+  vector<Vertex*> vertex_index;
+
+  // one symbolic analysis of L^T L serves every anchored solve
+  Solver_Type solver_type;
+  NormalSolver *normal_solver;
+  int normal_pattern_analyzed;
+
+  // PCG_SOLVER: relative residual to stop at and iteration limit
+  float pcg_tolerance;
+  int pcg_max_iterations;
+
+  // SCHWARZ_SOLVER: rings of neighbours added to every partition, and
+  // the solver with its subdomain factorizations for the partitions in
+  // schwarz_parts; emptied with the normal equations
+  int schwarz_overlap;
+  SchwarzSolver *schwarz_solver;
+  vector< vector<int> > schwarz_parts;
+
+  // batched greedy: anchors taken per solve, their minimum graph distance
+  // and how far below the round's maximum Mq a candidate may lie
+  // (fraction); greedy_tolerance is how far the maximum Mq after a round
+  // may exceed the last Mq picked in it before the rounds shrink, see
+  // select_greedy_anchors(). greedy_round is the current round size and
+  // greedy_round_floor that last Mq, 0 after a single anchor
+  int greedy_batch;
+  int greedy_separation;
+  float greedy_band;
+  float greedy_tolerance;
+  int greedy_round;
+  double greedy_round_floor;
+
+  // BVH of the original surface (positions, triangle_indices) for
+  // surface_distance(), rebuilt after either of them changes; queries
+  // come from the vertices plus about distance_samples area-weighted
+  // points per surface
+  TriangleBVH original_surface;
+  int original_surface_valid;
+  int distance_samples;
+
   MathVector model_centroid;
   float model_scale;
 };
@@ -0,0 +1,55 @@
+//
+//    File: normal_solver.cpp
+//
+//    Licensed under the terms of the Lesser General Public License.
+//
+
+#include <stdio.h>
+
+#include "normal_solver.h"
+
+NormalSolver* NormalSolver::create(Solver_Type type)
+{
+  switch (type)
+  {
+  case LU_SOLVER:
+    return new EigenNormalSolver< SparseLU<SpMatd, COLAMDOrdering<int> > >;
+  case LLT_SOLVER:
+    return new EigenNormalSolver< SimplicialLLT<SpMatd, Lower,
+				  AMDOrdering<int> > >;
+#ifdef MESH_USE_CHOLMOD
+  case CHOLMOD_SOLVER:
+    return new EigenNormalSolver< CholmodSupernodalLLT<SpMatd> >;
+#endif
+  case LDLT_SOLVER:
+    return new EigenNormalSolver< SimplicialLDLT<SpMatd, Lower,
+				  AMDOrdering<int> > >;
+  default:
+    fprintf(stderr, "%s not available, using %s\n", name(type),
+	    name(LDLT_SOLVER));
+    return create(LDLT_SOLVER);
+  }
+}
+
+int NormalSolver::available(Solver_Type type)
+{
+#ifndef MESH_USE_CHOLMOD
+  if (type == CHOLMOD_SOLVER)
+    return 0;
+#endif
+  return type != PCG_SOLVER && type != SCHWARZ_SOLVER;
+}
+
+const char* NormalSolver::name(Solver_Type type)
+{
+  switch (type)
+  {
+  case LU_SOLVER:      return "SparseLU";
+  case LDLT_SOLVER:    return "SimplicialLDLT";
+  case LLT_SOLVER:     return "SimplicialLLT";
+  case CHOLMOD_SOLVER: return "CholmodSupernodalLLT";
+  case PCG_SOLVER:     return "PCG";
+  case SCHWARZ_SOLVER: return "Schwarz";
+  }
+  return "unknown";
+}
@@ -0,0 +1,57 @@
+//
+//    File: normal_solver.h
+//
+//    Licensed under the terms of the Lesser General Public License.
+//
+
+#ifndef _NORMAL_SOLVER_H
+#define _NORMAL_SOLVER_H
+
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#ifdef MESH_USE_CHOLMOD
+#include <Eigen/CholmodSupport>
+#endif
+
+using namespace Eigen;
+
+typedef Eigen::SparseMatrix<double> SpMatd;
+
+typedef enum { LU_SOLVER, LDLT_SOLVER, LLT_SOLVER, CHOLMOD_SOLVER,
+	       PCG_SOLVER, SCHWARZ_SOLVER } Solver_Type;
+
+// Sparse direct solver for the normal equations L^T L + A^T A, which are
+// symmetric positive definite. The Cholesky backends use AMD ordering
+// and only factor the lower triangle; SparseLU is kept for comparison.
+// CHOLMOD_SOLVER (supernodal Cholesky) needs MESH_USE_CHOLMOD.
+// PCG_SOLVER is the matrix-free iterative path of Mesh and
+// SCHWARZ_SOLVER its domain-decomposed variant (SchwarzSolver); neither
+// is created here.
+class NormalSolver
+{
+public:
+  virtual ~NormalSolver() {}
+
+  virtual void analyze_pattern(const SpMatd *A) = 0;
+  virtual int factorize(const SpMatd *A) = 0;
+  virtual void solve(const MatrixXd &b, MatrixXd *x) = 0;
+
+  static NormalSolver* create(Solver_Type type);
+  static int available(Solver_Type type);
+  static const char* name(Solver_Type type);
+};
+
+template <class S>
+class EigenNormalSolver : public NormalSolver
+{
+public:
+  void analyze_pattern(const SpMatd *A) { solver.analyzePattern(*A); }
+  int factorize(const SpMatd *A)
+    { solver.factorize(*A); return solver.info() == Success ? 0 : 1; }
+  void solve(const MatrixXd &b, MatrixXd *x) { *x = solver.solve(b); }
+
+private:
+  S solver;
+};
+
+#endif
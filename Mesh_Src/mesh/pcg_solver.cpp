@@ -0,0 +1,62 @@
+//
+//    File: pcg_solver.cpp
+//
+//    Licensed under the terms of the Lesser General Public License.
+//
+
+#include "pcg_solver.h"
+
+int pcg_solve(const PCGOperator &op, const MatrixXd &b, MatrixXd *x,
+	      double tolerance, int max_iterations)
+{
+  int cols = b.cols();
+  int it, c;
+  MatrixXd r, z, p, q;
+  VectorXd rz(cols), bnorm(cols);
+  double alpha, beta, pq, rz_new;
+
+  op.multiply(*x, &q);
+  r = b - q;
+  op.precondition(r, &z);
+  p = z;
+  for (c=0; c < cols; c++)
+  {
+    rz(c) = r.col(c).dot(z.col(c));
+    bnorm(c) = b.col(c).norm();
+  }
+
+  for (it=0; it < max_iterations; it++)
+  {
+    for (c=0; c < cols; c++)
+      if (r.col(c).norm() > tolerance * bnorm(c))
+	break;
+    if (c == cols)
+      return it;
+
+    op.multiply(p, &q);
+    for (c=0; c < cols; c++)
+    {
+      pq = p.col(c).dot(q.col(c));
+      if (pq <= 0)
+	continue;
+      alpha = rz(c) / pq;
+      x->col(c) += alpha * p.col(c);
+      r.col(c) -= alpha * q.col(c);
+    }
+    op.precondition(r, &z);
+    for (c=0; c < cols; c++)
+    {
+      rz_new = r.col(c).dot(z.col(c));
+      beta = rz(c) > 0 ? rz_new / rz(c) : 0;
+      p.col(c) = z.col(c) + beta * p.col(c);
+      rz(c) = rz_new;
+    }
+  }
+
+  // the last step may have reached the tolerance
+  for (c=0; c < cols; c++)
+    if (r.col(c).norm() > tolerance * bnorm(c))
+      return -1;
+
+  return it;
+}
@@ -0,0 +1,35 @@
+//
+//    File: pcg_solver.h
+//
+//    Licensed under the terms of the Lesser General Public License.
+//
+
+#ifndef _PCG_SOLVER_H
+#define _PCG_SOLVER_H
+
+#include <Eigen/Dense>
+
+using namespace Eigen;
+
+// Symmetric positive definite operator M with a preconditioner P ~ M^-1,
+// both applied to one column per right-hand side
+class PCGOperator
+{
+public:
+  virtual ~PCGOperator() {}
+
+  // y = M x
+  virtual void multiply(const MatrixXd &x, MatrixXd *y) const = 0;
+  // z = P r
+  virtual void precondition(const MatrixXd &r, MatrixXd *z) const = 0;
+};
+
+// Preconditioned conjugate gradients on M x = b, the columns in lockstep.
+// x holds the start and gets the solution. The iteration stops once the
+// residual of every column is at most tolerance*|b| of that column; a
+// column whose search direction has p^T M p <= 0 is not updated in that
+// step. Returns the iterations, -1 if max_iterations were not enough.
+int pcg_solve(const PCGOperator &op, const MatrixXd &b, MatrixXd *x,
+	      double tolerance, int max_iterations);
+
+#endif
@@ -6,21 +6,213 @@
 //    Licensed under the terms of the Lesser General Public License.
 //
 
+#include <string.h>
+#include <io.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "ply_mesh.h"
 
+// scalar types of the PLY format
+enum { PLY_CHAR = 1, PLY_UCHAR, PLY_SHORT, PLY_USHORT, PLY_INT, PLY_UINT,
+       PLY_FLOAT, PLY_DOUBLE };
+
+static int ply_type(const char *name)
+{
+	if (strcmp(name, "char") == 0 || strcmp(name, "int8") == 0)
+		return PLY_CHAR;
+	if (strcmp(name, "uchar") == 0 || strcmp(name, "uint8") == 0)
+		return PLY_UCHAR;
+	if (strcmp(name, "short") == 0 || strcmp(name, "int16") == 0)
+		return PLY_SHORT;
+	if (strcmp(name, "ushort") == 0 || strcmp(name, "uint16") == 0)
+		return PLY_USHORT;
+	if (strcmp(name, "int") == 0 || strcmp(name, "int32") == 0)
+		return PLY_INT;
+	if (strcmp(name, "uint") == 0 || strcmp(name, "uint32") == 0)
+		return PLY_UINT;
+	if (strcmp(name, "float") == 0 || strcmp(name, "float32") == 0)
+		return PLY_FLOAT;
+	if (strcmp(name, "double") == 0 || strcmp(name, "float64") == 0)
+		return PLY_DOUBLE;
+	return 0;
+}
+
+static int ply_size(int type)
+{
+	static const int size[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+
+	return size[type];
+}
+
+// copies size bytes, reversed when the file and host byte order differ
+static void ply_copy(void *dest, const void *src, int size, int swap)
+{
+	const unsigned char *s = (const unsigned char*) src;
+	unsigned char *d = (unsigned char*) dest;
+	int i;
+
+	if (swap)
+		for (i=0; i < size; i++)
+			d[i] = s[size-1-i];
+	else
+		memcpy(d, s, size);
+}
+
+static double ply_value(const unsigned char *p, int type, int swap)
+{
+	char c; unsigned char uc; short s; unsigned short us;
+	int i; unsigned int ui; float f; double d;
+
+	switch (type)
+	{
+	case PLY_CHAR:   ply_copy(&c, p, 1, swap);  return c;
+	case PLY_UCHAR:  ply_copy(&uc, p, 1, swap); return uc;
+	case PLY_SHORT:  ply_copy(&s, p, 2, swap);  return s;
+	case PLY_USHORT: ply_copy(&us, p, 2, swap); return us;
+	case PLY_INT:    ply_copy(&i, p, 4, swap);  return i;
+	case PLY_UINT:   ply_copy(&ui, p, 4, swap); return ui;
+	case PLY_FLOAT:  ply_copy(&f, p, 4, swap);  return f;
+	case PLY_DOUBLE: ply_copy(&d, p, 8, swap);  return d;
+	}
+	return 0;
+}
+
+// number parsers for the mapped ASCII reader: no locale, no allocation;
+// they return the position after the number or NULL
+
+static const double power_of_ten[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+static const char* parse_float(const char *p, const char *end, float *value)
+{
+	unsigned __int64 mantissa = 0;
+	int digits = 0, exponent = 0, e = 0, negative = 0, e_negative, any = 0;
+	const char *s;
+	double v;
+
+	while (p < end && (*p == ' ' || *p == '\t'))
+		p++;
+	s = p;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+	for (; p < end && *p >= '0' && *p <= '9'; p++, any = 1)
+	{
+		if (digits < 19)
+		{
+			mantissa = mantissa * 10 + (*p - '0');
+			if (mantissa)
+				digits++;
+		}
+		else
+			exponent++;
+	}
+	if (p < end && *p == '.')
+		for (p++; p < end && *p >= '0' && *p <= '9'; p++, any = 1)
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				if (mantissa)
+					digits++;
+				exponent--;
+			}
+	if (!any)
+	{
+		// nan, inf and other spellings go through strtod
+		char buffer[64];
+		int n = 0;
+		char *stop;
+		while (s + n < end && n < 63 && s[n] > ' ')
+		{
+			buffer[n] = s[n];
+			n++;
+		}
+		buffer[n] = '\0';
+		v = strtod(buffer, &stop);
+		if (stop == buffer)
+			return NULL;
+		*value = (float) v;
+		return s + (stop - buffer);
+	}
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		s = p++;
+		e_negative = 0;
+		if (p < end && (*p == '-' || *p == '+'))
+			e_negative = *p++ == '-';
+		if (p < end && *p >= '0' && *p <= '9')
+		{
+			for (; p < end && *p >= '0' && *p <= '9'; p++)
+				if (e < 10000)
+					e = e * 10 + (*p - '0');
+			exponent += e_negative ? -e : e;
+		}
+		else
+			p = s;
+	}
+
+	v = (double) mantissa;
+	if (exponent < 0)
+		v = -exponent <= 22 ? v / power_of_ten[-exponent] : v * pow(10.0, exponent);
+	else if (exponent > 0)
+		v = exponent <= 22 ? v * power_of_ten[exponent] : v * pow(10.0, exponent);
+	*value = (float) (negative ? -v : v);
+
+	return p;
+}
+
+static const char* parse_int(const char *p, const char *end, int *value)
+{
+	int v = 0, negative = 0;
+	const char *s;
+
+	while (p < end && (*p == ' ' || *p == '\t'))
+		p++;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+	for (s = p; p < end && *p >= '0' && *p <= '9'; p++)
+		v = v * 10 + (*p - '0');
+	if (p == s)
+		return NULL;
+	*value = negative ? -v : v;
+
+	return p;
+}
+
+static int host_is_little_endian(void)
+{
+	int one = 1;
+
+	return *(char*) &one == 1;
+}
+
+PLY_Mesh::PLY_Mesh(void)
+{
+	format = PLY_ASCII;
+}
+
+void PLY_Mesh::set_format(Ply_Format format)
+{
+	this->format = format;
+}
+
 int PLY_Mesh::read(FILE *f, int (*update_progress)(int pos),
 				   void (*set_total)(int size))
 {
 	list<Triangle*> *shape_triangles;
 	list<Vertex*> *shape_vertices;
 	vector<Vertex*> vertex_index;
-	int p1, p2, p3, i, v_nr, p_nr;
-	char nr; 
-	float x, y, z;
-	Triangle *tri;
-	Vertex *v;
+	vector<Ply_Element> elements;
+	Ply_Element element;
+	Ply_Property property;
+	Ply_Format file_format = PLY_ASCII;
+	int v_nr = 0, p_nr = 0, error;
+	vector<Ply_Element>::size_type st;
 
-	char buffer[101];
+	char line[1024];
+	char buffer[101], type[101], name[101];
 
 	fseek(f, 0, SEEK_END);
 	(*set_total)(ftell(f));
@@ -28,43 +220,136 @@ int PLY_Mesh::read(FILE *f, int (*update_progress)(int pos),
 
 	// READ IN HEADER
 
-	while (fgetc(f) != '\n') // Reads all of the 1st line
-		;
+	// the header is read line by line: binary data starts right after
+	// the end_header line and may begin with whitespace bytes
 
-	// read the remainder of the header
-	// - interested in 3 parts only
-	// - format
-	// - number of vertices
-	// - number of polygons
+	if (fgets(line, sizeof(line), f) == NULL || strncmp(line, "ply", 3) != 0)
+	{
+		FILE_ERROR(f, "PLY file format error: missing magic number");
+		return 3;
+	}
+
+	for (;;)
+	{
+		if (fgets(line, sizeof(line), f) == NULL)
+		{
+			FILE_ERROR(f, "PLY file format error: missing end_header");
+			return 3;
+		}
+		if (sscanf(line, "%100s", buffer) != 1)
+			continue;
 
-	fscanf(f,"%100s ", buffer);
-	while (strcasecmp(buffer, "end_header") != 0){
+		if (strcasecmp(buffer, "end_header") == 0)
+			break;
 
 		if (strcasecmp(buffer, "format") == 0){
 
-			fscanf(f,"%100s ", buffer);
-			if (strcasecmp(buffer, "ascii") != 0){
-				FILE_ERROR(f, 
-					"PLY file format error: PLY ASCII support only.");
+			sscanf(line, "%*s %100s", buffer);
+			if (strcasecmp(buffer, "ascii") == 0)
+				file_format = PLY_ASCII;
+			else if (strcasecmp(buffer, "binary_little_endian") == 0)
+				file_format = PLY_BINARY_LITTLE_ENDIAN;
+			else if (strcasecmp(buffer, "binary_big_endian") == 0)
+				file_format = PLY_BINARY_BIG_ENDIAN;
+			else {
+				FILE_ERROR(f, "PLY file format error: unknown format");
 				return 3;
 			}
 
 		} else if (strcasecmp(buffer, "element") == 0){
-			fscanf(f,"%100s ", buffer);
-			if (strcasecmp(buffer, "vertex") == 0){
-				fscanf(f,"%100s", buffer);
-				v_nr = atoi(buffer);
-			} else if (strcasecmp(buffer, "face") == 0){
-				fscanf(f,"%100s", buffer);
-				p_nr = atoi(buffer);
+
+			if (sscanf(line, "%*s %100s %d", name, &element.count) != 2)
+			{
+				FILE_ERROR(f, "PLY file format error: element");
+				return 3;
 			}
+			element.name = name;
+			elements.push_back(element);
+
+		} else if (strcasecmp(buffer, "property") == 0){
+
+			if (elements.empty())
+			{
+				FILE_ERROR(f, "PLY file format error: property without element");
+				return 3;
+			}
+			sscanf(line, "%*s %100s", buffer);
+			if (strcasecmp(buffer, "list") == 0)
+			{
+				if (sscanf(line, "%*s %*s %100s %100s %100s",
+					   buffer, type, name) != 3)
+					buffer[0] = '\0';
+				property.count_type = ply_type(buffer);
+			}
+			else
+			{
+				if (sscanf(line, "%*s %100s %100s", type, name) != 2)
+					type[0] = '\0';
+				property.count_type = 0;
+			}
+			property.type = ply_type(type);
+			property.name = name;
+			if (property.type == 0 || (strcasecmp(buffer, "list") == 0
+						  && property.count_type == 0))
+			{
+				FILE_ERROR(f, "PLY file format error: property type");
+				return 3;
+			}
+			elements.back().properties.push_back(property);
 		}
-		fscanf(f,"%100s ", buffer);
+	}
+
+	for (st=0; st < elements.size(); st++)
+	{
+		if (elements[st].name == "vertex")
+			v_nr = elements[st].count;
+		else if (elements[st].name == "face")
+			p_nr = elements[st].count;
 	}
 
 	shape_triangles = new list<Triangle*>;
 	shape_vertices = new list<Vertex*>;
 
+	// one block each for the vertices and faces of the file
+	vertex_pool.reserve(v_nr);
+	triangle_pool.reserve(p_nr);
+
+	if (file_format == PLY_ASCII)
+	{
+		// streams that cannot be mapped fall back to fscanf
+		error = read_ascii_mapped(f, v_nr, p_nr, update_progress,
+					  &vertex_index, shape_triangles);
+		if (error < 0)
+			error = read_ascii(f, v_nr, p_nr, update_progress,
+					   &vertex_index, shape_triangles);
+	}
+	else
+		error = read_binary(f, elements,
+				    (file_format == PLY_BINARY_LITTLE_ENDIAN)
+				    != host_is_little_endian(), update_progress,
+				    &vertex_index, shape_triangles);
+	if (error)
+		return error;
+
+	// copy the vertices of this shape over
+	shape_vertices->insert(shape_vertices->begin(),
+		vertex_index.begin(), vertex_index.end());
+	shapes->push_back(new_shape(shape_triangles, shape_vertices));
+
+	return 0;
+}
+
+int PLY_Mesh::read_ascii(FILE *f, int v_nr, int p_nr,
+						 int (*update_progress)(int pos),
+						 vector<Vertex*> *vertex_index,
+						 list<Triangle*> *shape_triangles)
+{
+	int p1, p2, p3, i;
+	char nr;
+	float x, y, z;
+	Triangle *tri;
+	Vertex *v;
+
 	// READ IN VERTICES
 
 	for (i=0; i < v_nr; i++) // Reads the vertices
@@ -77,11 +362,11 @@ int PLY_Mesh::read(FILE *f, int (*update_progress)(int pos),
 		while (fgetc(f) != '\n'); // Read till end of the line
 		// to skip texture/colour values
 
-		v = new Vertex(x,y,z);
+		v = new_vertex(x,y,z);
 		add_vertex(v);
 
 		// save in a vector for the triangles and shape
-		vertex_index.push_back(v);
+		vertex_index->push_back(v);
 
 		if ((*update_progress)(ftell(f)))
 			return 90;
@@ -101,7 +386,7 @@ int PLY_Mesh::read(FILE *f, int (*update_progress)(int pos),
 				FILE_ERROR(f, "PLY file format error: polygon 2");
 				return 6;
 			}
-			add_edge(new Edge(vertex_index[p1], vertex_index[p2]));
+			add_edge(new_edge((*vertex_index)[p1], (*vertex_index)[p2]));
 			p_nr--;
 			break;
 
@@ -115,8 +400,8 @@ int PLY_Mesh::read(FILE *f, int (*update_progress)(int pos),
 				FILE_ERROR(f, "PLY file format error: vertex index out of range");
 				return 8;
 			} else { 
-				tri = new Triangle(vertex_index[p1], vertex_index[p2],
-					vertex_index[p3]);
+				tri = new_triangle((*vertex_index)[p1], (*vertex_index)[p2],
+					(*vertex_index)[p3]);
 				add_triangle(tri);
 				p_nr--;
 			}
@@ -146,23 +431,354 @@ int PLY_Mesh::read(FILE *f, int (*update_progress)(int pos),
 			return 90;
 	}
 
-	// copy the vertices of this shape over
-	shape_vertices->insert(shape_vertices->begin(),
-		vertex_index.begin(), vertex_index.end());
-	shapes->push_back(new Shape(shape_triangles, shape_vertices));
+	return 0;
+}
+
+int PLY_Mesh::read_ascii_mapped(FILE *f, int v_nr, int p_nr,
+								int (*update_progress)(int pos),
+								vector<Vertex*> *vertex_index,
+								list<Triangle*> *shape_triangles)
+{
+	HANDLE file, mapping;
+	const char *base, *body;
+	__int64 start, end;
+	size_t size;
+	int threads, t, i, lines_nr, faces_nr = 0, bad = 0;
+	// byte offsets of the lines, which pass 4 GB in large files
+	vector< vector<size_t> > chunk_lines;
+	vector<size_t> lines;
+	vector<float> xyz;
+	vector<int> faces;
+	Triangle *tri;
+	Vertex *v;
+
+	start = _ftelli64(f);
+	_fseeki64(f, 0, SEEK_END);
+	end = _ftelli64(f);
+	_fseeki64(f, start, SEEK_SET);
+	if (end <= start)
+		return -1;
+
+	file = (HANDLE) _get_osfhandle(_fileno(f));
+	if (file == INVALID_HANDLE_VALUE)
+		return -1;
+	mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL)
+		return -1;
+	base = (const char*) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (base == NULL)
+	{
+		CloseHandle(mapping);
+		return -1;
+	}
+	body = base + start;
+	size = (size_t) (end - start);
+
+#ifdef _OPENMP
+	threads = omp_get_max_threads();
+#else
+	threads = 1;
+#endif
+
+	// INDEX THE LINES
+
+	// every thread takes the lines starting in its share of the bytes and
+	// keeps the ones that are not blank, as fscanf would skip those
+	chunk_lines.resize(threads);
+#pragma omp parallel for private(i)
+	for (t=0; t < threads; t++)
+	{
+		size_t a = size / threads * t, b = size / threads * (t+1), c;
+		if (t == threads-1)
+			b = size;
+		while (a > 0 && a < size && body[a-1] != '\n')
+			a++;
+		while (b > 0 && b < size && body[b-1] != '\n')
+			b++;
+		for (c = a; c < b; )
+		{
+			for (i = 0; c + i < size && body[c+i] != '\n'; i++)
+				if (body[c+i] > ' ')
+					break;
+			if (c + i < size && body[c+i] != '\n')
+				chunk_lines[t].push_back(c);
+			while (c < size && body[c] != '\n')
+				c++;
+			c++;
+		}
+	}
+	for (t=0; t < threads; t++)
+		lines.insert(lines.end(), chunk_lines[t].begin(), chunk_lines[t].end());
+	lines.push_back(size);
+	lines_nr = lines.size() - 1;
+
+	if ((*update_progress)((int) (start + size / 4)))
+	{
+		UnmapViewOfFile(base);
+		CloseHandle(mapping);
+		return 90;
+	}
+
+	// PARSE VERTICES AND POLYGONS
+
+	if (lines_nr < v_nr)
+		bad = 1;
+	else
+	{
+		xyz.resize(3 * v_nr + 1);
+#pragma omp parallel for reduction(+:bad)
+		for (i=0; i < v_nr; i++)
+		{
+			const char *p = body + lines[i], *e = body + lines[i+1];
+			if ((p = parse_float(p, e, &xyz[3*i])) == NULL ||
+			    (p = parse_float(p, e, &xyz[3*i+1])) == NULL ||
+			    (p = parse_float(p, e, &xyz[3*i+2])) == NULL)
+				bad++;
+		}
+	}
+	if (!bad)
+	{
+		faces_nr = lines_nr - v_nr;
+		faces.resize(4 * faces_nr + 1);
+
+		// faces[4*i] is 2 or 3 for a parsed edge or triangle, minus that
+		// for a malformed one and 0 for lines that are skipped
+#pragma omp parallel for
+		for (i=0; i < faces_nr; i++)
+		{
+			const char *p = body + lines[v_nr + i], *e = body + lines[v_nr + i + 1];
+			int *face = &faces[4*i];
+			while (*p == ' ' || *p == '\t')
+				p++;
+			face[0] = 0;
+			if ((*p == '2' || *p == '3') && (p+1 == e || p[1] <= ' '))
+			{
+				face[0] = *p - '0';
+				p++;
+				if ((p = parse_int(p, e, &face[1])) == NULL ||
+				    (p = parse_int(p, e, &face[2])) == NULL ||
+				    (face[0] == 3 && parse_int(p, e, &face[3]) == NULL))
+					face[0] = -face[0];
+			}
+		}
+	}
+
+	UnmapViewOfFile(base);
+	CloseHandle(mapping);
+
+	if (bad)
+	{
+		FILE_ERROR(f, "PLY file format error: vertex list");
+		return 3;
+	}
+
+	// BUILD THE MESH
+
+	for (i=0; i < v_nr; i++)
+	{
+		v = new_vertex(xyz[3*i], xyz[3*i+1], xyz[3*i+2]);
+		add_vertex(v);
+
+		// save in a vector for the triangles and shape
+		vertex_index->push_back(v);
+
+		if ((i & 0xffff) == 0xffff && (*update_progress)((int) (start + lines[i])))
+			return 90;
+	}
+
+	for (i=0; i < faces_nr && 0 < p_nr; i++)
+	{
+		const int *face = &faces[4*i];
+		switch (face[0])
+		{
+		case 2:
+			if (face[1] < 0 || face[1] >= ver_nr || face[2] < 0 || face[2] >= ver_nr){
+				FILE_ERROR(f, "PLY file format error: vertex index out of range");
+				return 8;
+			}
+			add_edge(new_edge((*vertex_index)[face[1]], (*vertex_index)[face[2]]));
+			p_nr--;
+			break;
+
+		case 3:
+			if (face[1] < 0 || face[1] >= ver_nr || face[2] < 0 || face[2] >= ver_nr ||
+			    face[3] < 0 || face[3] >= ver_nr){
+				FILE_ERROR(f, "PLY file format error: vertex index out of range");
+				return 8;
+			}
+			tri = new_triangle((*vertex_index)[face[1]], (*vertex_index)[face[2]],
+				(*vertex_index)[face[3]]);
+			add_triangle(tri);
+			p_nr--;
+			// save in a list for the shape
+			shape_triangles->push_back(tri);
+			break;
+
+		case -2:
+			FILE_ERROR(f, "PLY file format error: polygon 2");
+			return 6;
 
+		case -3:
+			FILE_ERROR(f, "PLY file format error: polygon 3");
+			return 7;
+		}
+
+		if ((i & 0xffff) == 0xffff && (*update_progress)((int) (start + lines[v_nr + i])))
+			return 90;
+	}
+
+	fseek(f, 0, SEEK_END);
 	return 0;
 }
 
-void PLY_Mesh::write(FILE *f, const char *comment)
+int PLY_Mesh::read_binary(FILE *f, const vector<Ply_Element> &elements,
+						  int swap, int (*update_progress)(int pos),
+						  vector<Vertex*> *vertex_index,
+						  list<Triangle*> *shape_triangles)
 {
-	int n;
-	list<Triangle*>::iterator it;
-	list<Vertex*>::iterator iv;
-	Vertex v;
+	vector<unsigned char> data;
+	vector<int> offset;
+	vector<Ply_Element>::size_type st;
+	vector<Ply_Property>::size_type sp;
+	long start, end;
+	size_t size, pos, item;
+	int i, j, n, p[3], x_nr, y_nr, z_nr, index_nr;
+	double count;
+	const unsigned char *d;
+	Triangle *tri;
+	Vertex *v;
 
+	// the whole body is read with one fread and decoded in memory
+	start = ftell(f);
+	fseek(f, 0, SEEK_END);
+	end = ftell(f);
+	fseek(f, start, SEEK_SET);
+	data.resize(end - start + 1);
+	size = fread(&data[0], 1, end - start, f);
+
+	pos = 0;
+	for (st=0; st < elements.size(); st++)
+	{
+		const Ply_Element &e = elements[st];
+		offset.resize(e.properties.size());
+
+		x_nr = y_nr = z_nr = index_nr = -1;
+		for (sp=0; sp < e.properties.size(); sp++)
+		{
+			const Ply_Property &pr = e.properties[sp];
+			if (pr.count_type == 0 && pr.name == "x")
+				x_nr = sp;
+			else if (pr.count_type == 0 && pr.name == "y")
+				y_nr = sp;
+			else if (pr.count_type == 0 && pr.name == "z")
+				z_nr = sp;
+			else if (pr.count_type != 0 && (pr.name == "vertex_indices"
+							|| pr.name == "vertex_index"))
+				index_nr = sp;
+		}
+		if (e.name == "vertex" && (x_nr < 0 || y_nr < 0 || z_nr < 0))
+		{
+			FILE_ERROR(f, "PLY file format error: vertex without x y z");
+			return 3;
+		}
+
+		for (i=0; i < e.count; i++)
+		{
+			// locate the properties of this item
+			item = pos;
+			for (sp=0; sp < e.properties.size(); sp++)
+			{
+				const Ply_Property &pr = e.properties[sp];
+				offset[sp] = pos - item;
+				if (pr.count_type == 0)
+				{
+					pos += ply_size(pr.type);
+				}
+				else
+				{
+					if (pos + ply_size(pr.count_type) > size)
+						break;
+					count = ply_value(&data[pos], pr.count_type, swap);
+					pos += ply_size(pr.count_type);
+					// the list has to fit into the rest of the body
+					if (count < 0 || count > (size - pos) / ply_size(pr.type))
+						break;
+					pos += (size_t) count * ply_size(pr.type);
+				}
+			}
+			if (sp < e.properties.size() || pos > size)
+			{
+				FILE_ERROR(f, e.name == "vertex" ?
+					   "PLY file format error: vertex list" :
+					   "PLY file format error: element list");
+				return 3;
+			}
+			d = &data[item];
+
+			if (e.name == "vertex")
+			{
+				v = new_vertex(
+					(float) ply_value(d + offset[x_nr], e.properties[x_nr].type, swap),
+					(float) ply_value(d + offset[y_nr], e.properties[y_nr].type, swap),
+					(float) ply_value(d + offset[z_nr], e.properties[z_nr].type, swap));
+				add_vertex(v);
+
+				// save in a vector for the triangles and shape
+				vertex_index->push_back(v);
+			}
+			else if (e.name == "face" && index_nr >= 0)
+			{
+				const Ply_Property &pr = e.properties[index_nr];
+				d += offset[index_nr];
+				n = (int) ply_value(d, pr.count_type, swap);
+				d += ply_size(pr.count_type);
+				if (n == 2 || n == 3)
+				{
+					for (j=0; j < n; j++)
+					{
+						p[j] = (int) ply_value(d + j * ply_size(pr.type),
+								       pr.type, swap);
+						if (p[j] < 0 || p[j] >= ver_nr)
+						{
+							FILE_ERROR(f, "PLY file format error: vertex index out of range");
+							return 8;
+						}
+					}
+					if (n == 2)
+					{
+						add_edge(new_edge((*vertex_index)[p[0]],
+								  (*vertex_index)[p[1]]));
+					}
+					else
+					{
+						tri = new_triangle((*vertex_index)[p[0]],
+								   (*vertex_index)[p[1]],
+								   (*vertex_index)[p[2]]);
+						add_triangle(tri);
+						// save in a list for the shape
+						shape_triangles->push_back(tri);
+					}
+				}
+				// polygons with more vertices are skipped as in ASCII files
+			}
+
+			if ((i & 4095) == 0 && (*update_progress)(start + pos))
+				return 90;
+		}
+	}
+
+	return 0;
+}
+
+void PLY_Mesh::write(FILE *f, const char *comment)
+{
 	fprintf(f, "ply\n");
-	fprintf(f, "format ascii 1.0\n");
+	if (format == PLY_BINARY_LITTLE_ENDIAN)
+		fprintf(f, "format binary_little_endian 1.0\n");
+	else if (format == PLY_BINARY_BIG_ENDIAN)
+		fprintf(f, "format binary_big_endian 1.0\n");
+	else
+		fprintf(f, "format ascii 1.0\n");
 	fprintf(f, "comment %s\n", comment);
 	fprintf(f, "element vertex %i\n", ver_nr);
 	fprintf(f, "property float x\n");
@@ -178,25 +794,56 @@ void PLY_Mesh::write(FILE *f, const char *comment)
 	fprintf(f, "property list uchar int vertex_indices\n");
 	fprintf(f, "end_header\n");
 
-	n=0;    // vertices
-	//for (iv=vertices->begin(); iv != vertices->end(); iv++)
-	//{
-	//	/*calc_original_coordinates(*iv, &v);
-	//	fprintf(f,"%f %f %f\n", v.x(), v.y(), v.z());*/
-	//	fprintf(f,"%f %f %f\n", (*iv)->x(), (*iv)->y(), (*iv)->z());
-	//	(*iv)->number=++n;
-	//}
+	if (format != PLY_ASCII)
+	{
+		write_binary(f, (format == PLY_BINARY_LITTLE_ENDIAN)
+			     != host_is_little_endian());
+		return;
+	}
 
+	write_ply_records(f);
+}
+
+void PLY_Mesh::write_binary(FILE *f, int swap)
+{
+	const int vertex_size = 3 * sizeof(float) + 4;
+	const int face_size = 1 + 3 * sizeof(int);
+	vector<unsigned char> buffer;
+	unsigned char *p;
+	list<Triangle*>::iterator it;
+	list<Vertex*>::iterator iv;
+	int n, i, index;
+
+	// vertices: float x y z, uchar red green blue alpha
+	buffer.resize(vertices->size() * vertex_size + 1);
+	p = &buffer[0];
+	n = 0;
 	for (iv=vertices->begin(); iv != vertices->end(); iv++)
 	{
-		/*calc_original_coordinates(*iv, &v);
-		fprintf(f,"%f %f %f\n", v.x(), v.y(), v.z());*/
-		fprintf(f,"%f %f %f %d %d %d %d\n", (*iv)->math_newdata()->v[0], (*iv)->math_newdata()->v[1], (*iv)->math_newdata()->v[2],(*iv)->color[0],(*iv)->color[1],(*iv)->color[2],255);
+		for (i=0; i < 3; i++)
+			ply_copy(p + i * sizeof(float), &(*iv)->math_newdata()->v[i],
+				 sizeof(float), swap);
+		p[12] = (unsigned char) (*iv)->color[0];
+		p[13] = (unsigned char) (*iv)->color[1];
+		p[14] = (unsigned char) (*iv)->color[2];
+		p[15] = 255;
+		p += vertex_size;
 		(*iv)->number=++n;
 	}
+	fwrite(&buffer[0], vertex_size, vertices->size(), f);
 
-	// triangles
+	// triangles: uchar 3, int v1 v2 v3
+	buffer.resize(triangles->size() * face_size + 1);
+	p = &buffer[0];
 	for (it=triangles->begin(); it != triangles->end(); it++)
-		fprintf(f,"3 %d %d %d\n", ((*it)->vertices[0]->number - 1),
-		((*it)->vertices[1]->number - 1), ((*it)->vertices[2]->number) - 1);
+	{
+		p[0] = 3;
+		for (i=0; i < 3; i++)
+		{
+			index = (*it)->vertices[i]->number - 1;
+			ply_copy(p + 1 + i * sizeof(int), &index, sizeof(int), swap);
+		}
+		p += face_size;
+	}
+	fwrite(&buffer[0], face_size, triangles->size(), f);
 }
@@ -9,16 +9,59 @@
 #ifndef _PLY_MESH_H
 #define _PLY_MESH_H
 
+#include <string>
+
 #include "mesh.h"
 
 using namespace std;
 
+typedef enum { PLY_ASCII, PLY_BINARY_LITTLE_ENDIAN,
+	       PLY_BINARY_BIG_ENDIAN } Ply_Format;
+
+// one "property" line of a PLY header; count_type is 0 for scalars
+typedef struct
+{
+  string name;
+  int type;
+  int count_type;
+} Ply_Property;
+
+// one "element" line of a PLY header with its properties
+typedef struct
+{
+  string name;
+  int count;
+  vector<Ply_Property> properties;
+} Ply_Element;
+
 class PLY_Mesh : public Mesh
 {
 public:
+  PLY_Mesh(void);
+
   int read(FILE *f, int (*update_progress)(int pos),
 	   void (*set_total)(int size));
   void write(FILE *f, const char *comment = "");
+
+  // format used by write(); binary files must be opened with "rb"/"wb"
+  void set_format(Ply_Format format);
+
+private:
+  int read_ascii(FILE *f, int v_nr, int p_nr,
+		 int (*update_progress)(int pos),
+		 vector<Vertex*> *vertex_index,
+		 list<Triangle*> *shape_triangles);
+  int read_ascii_mapped(FILE *f, int v_nr, int p_nr,
+			int (*update_progress)(int pos),
+			vector<Vertex*> *vertex_index,
+			list<Triangle*> *shape_triangles);
+  int read_binary(FILE *f, const vector<Ply_Element> &elements,
+		  int swap, int (*update_progress)(int pos),
+		  vector<Vertex*> *vertex_index,
+		  list<Triangle*> *shape_triangles);
+  void write_binary(FILE *f, int swap);
+
+  Ply_Format format;
 };
 
 #endif
@@ -0,0 +1,157 @@
+//
+//    File: pool.h
+//
+//    Licensed under the terms of the Lesser General Public License.
+//
+
+#ifndef _POOL_H
+#define _POOL_H
+
+#include <vector>
+#include <new>
+
+using namespace std;
+
+// Typed arena for the mesh primitives. Objects are constructed in place
+// inside blocks of doubling size, so n objects cost O(log n) allocations
+// and objects of one kind lie next to each other. Released slots are
+// reused. clear() destroys the live objects and frees the blocks.
+template <class T> class Pool
+{
+public:
+  Pool(int first_block = 1024);
+  ~Pool();
+
+  // raw storage for one object, to be used with placement new
+  void* allocate(void);
+  // make room for n more objects in a single block
+  void reserve(int n);
+  // destroys p; objects that are not from this pool are deleted
+  void destroy(T *p);
+  void clear(void);
+
+  int owns(const T *p) const;
+  int size(void) const;
+
+private:
+  typedef struct
+  {
+    T *data;
+    int capacity, used;
+    vector<char> alive;
+  } Block;
+
+  int locate(const T *p) const;
+
+  vector<Block> blocks;
+  vector<T*> free_slots;
+  int first_block, live;
+
+  Pool(const Pool &);
+  Pool& operator=(const Pool &);
+};
+
+template <class T> Pool<T>::Pool(int first_block)
+{
+  this->first_block = first_block;
+  live = 0;
+}
+
+template <class T> Pool<T>::~Pool()
+{
+  clear();
+}
+
+template <class T> void* Pool<T>::allocate(void)
+{
+  T *p;
+  int b;
+
+  if (!free_slots.empty())
+    {
+      p = free_slots.back();
+      free_slots.pop_back();
+      b = locate(p);
+      blocks[b].alive[p - blocks[b].data] = 1;
+      live++;
+      return p;
+    }
+
+  if (blocks.empty() || blocks.back().used == blocks.back().capacity)
+    reserve(blocks.empty() ? first_block : blocks.back().capacity);
+
+  Block &last = blocks.back();
+  last.alive[last.used] = 1;
+  live++;
+  return last.data + last.used++;
+}
+
+template <class T> void Pool<T>::reserve(int n)
+{
+  Block b;
+
+  if (n <= 0 || (!blocks.empty() &&
+		 blocks.back().capacity - blocks.back().used >= n))
+    return;
+
+  b.data = static_cast<T*>(::operator new(n * sizeof(T)));
+  b.capacity = n;
+  b.used = 0;
+  blocks.push_back(b);
+  blocks.back().alive.resize(n, 0);
+}
+
+template <class T> void Pool<T>::destroy(T *p)
+{
+  int b = locate(p);
+
+  if (b < 0)
+    {
+      delete p;
+      return;
+    }
+
+  p->~T();
+  blocks[b].alive[p - blocks[b].data] = 0;
+  free_slots.push_back(p);
+  live--;
+}
+
+template <class T> void Pool<T>::clear(void)
+{
+  int b, i;
+
+  for (b=0; b < (int) blocks.size(); b++)
+    {
+      for (i=0; i < blocks[b].used; i++)
+	if (blocks[b].alive[i])
+	  blocks[b].data[i].~T();
+      ::operator delete(blocks[b].data);
+    }
+
+  blocks.clear();
+  free_slots.clear();
+  live = 0;
+}
+
+template <class T> int Pool<T>::owns(const T *p) const
+{
+  return locate(p) >= 0;
+}
+
+template <class T> int Pool<T>::size(void) const
+{
+  return live;
+}
+
+template <class T> int Pool<T>::locate(const T *p) const
+{
+  // few blocks, the last ones being the largest
+  for (int b=blocks.size()-1; b >= 0; b--)
+    if (p >= blocks[b].data && p < blocks[b].data + blocks[b].used)
+      return b;
+
+  return -1;
+}
+
+#endif
@@ -0,0 +1,306 @@
+//
+//    File: range_coder.cpp
+//
+//    Licensed under the terms of the Lesser General Public License.
+//
+
+#include <string.h>
+#include <math.h>
+
+#include "range_coder.h"
+
+#define RC_TOP (1u << 24)
+#define RC_BOTTOM (1u << 16)
+#define MODEL_INCREMENT 24
+#define MODEL_LIMIT (1u << 16)
+
+AdaptiveModel::AdaptiveModel(int symbols)
+{
+  counts.assign(symbols, 1);
+  for (top_bit=1; 2*top_bit <= symbols; top_bit*=2)
+    ;
+  rebuild();
+}
+
+int AdaptiveModel::symbols(void) const
+{
+  return counts.size();
+}
+
+unsigned int AdaptiveModel::total(void) const
+{
+  return sum;
+}
+
+void AdaptiveModel::rebuild(void)
+{
+  int i, j, n = counts.size();
+
+  tree.assign(n+1, 0);
+  sum = 0;
+  for (i=1; i <= n; i++)
+  {
+    tree[i] += counts[i-1];
+    sum += counts[i-1];
+    j = i + (i & -i);
+    if (j <= n)
+      tree[j] += tree[i];
+  }
+}
+
+void AdaptiveModel::interval(int s, unsigned int *cum,
+			     unsigned int *freq) const
+{
+  unsigned int c = 0;
+
+  for (int i=s; i > 0; i -= i & -i)
+    c += tree[i];
+  *cum = c;
+  *freq = counts[s];
+}
+
+int AdaptiveModel::find(unsigned int target, unsigned int *cum,
+			unsigned int *freq) const
+{
+  int s = 0, n = counts.size();
+  unsigned int c = 0;
+
+  // largest s whose cumulative count is <= target
+  for (int step=top_bit; step > 0; step /= 2)
+    if (s + step <= n && c + tree[s+step] <= target)
+    {
+      s += step;
+      c += tree[s];
+    }
+  *cum = c;
+  *freq = counts[s];
+
+  return s;
+}
+
+void AdaptiveModel::update(int s)
+{
+  int n = counts.size();
+
+  if (sum + MODEL_INCREMENT >= MODEL_LIMIT)
+  {
+    for (int i=0; i < n; i++)
+      counts[i] = (counts[i] + 1) / 2;
+    rebuild();
+  }
+  counts[s] += MODEL_INCREMENT;
+  sum += MODEL_INCREMENT;
+  for (int i=s+1; i <= n; i += i & -i)
+    tree[i] += MODEL_INCREMENT;
+}
+
+RangeEncoder::RangeEncoder(vector<unsigned char> *out)
+{
+  this->out = out;
+  low = 0;
+  range = 0xFFFFFFFFu;
+}
+
+void RangeEncoder::encode(unsigned int cum, unsigned int freq,
+			  unsigned int total)
+{
+  range /= total;
+  low += cum * range;
+  range *= freq;
+  // shift out settled top bytes; a small range straddling a byte
+  // boundary is cut down to the part below it
+  while ((low ^ (low + range)) < RC_TOP ||
+	 (range < RC_BOTTOM && ((range = -low & (RC_BOTTOM - 1)), 1)))
+  {
+    out->push_back((unsigned char) (low >> 24));
+    low <<= 8;
+    range <<= 8;
+  }
+}
+
+void RangeEncoder::encode(int s, AdaptiveModel *model)
+{
+  unsigned int cum, freq;
+
+  model->interval(s, &cum, &freq);
+  encode(cum, freq, model->total());
+  model->update(s);
+}
+
+void RangeEncoder::encode_bits(unsigned int value, int bits)
+{
+  // at most 16 bits per step
+  while (bits > 16)
+  {
+    bits -= 16;
+    encode((value >> bits) & 0xFFFF, 1, 1u << 16);
+  }
+  if (bits > 0)
+    encode(value & ((1u << bits) - 1), 1, 1u << bits);
+}
+
+void RangeEncoder::encode_number(unsigned int value, AdaptiveModel *lengths)
+{
+  int bits = 0;
+
+  while (bits < 32 && (value >> bits) != 0)
+    bits++;
+  encode(bits, lengths);
+  if (bits > 1)
+    encode_bits(value, bits - 1);
+}
+
+void RangeEncoder::finish(void)
+{
+  for (int i=0; i < 4; i++)
+  {
+    out->push_back((unsigned char) (low >> 24));
+    low <<= 8;
+  }
+}
+
+RangeDecoder::RangeDecoder(const unsigned char *data, int size)
+{
+  this->data = data;
+  this->size = size;
+  pos = 0;
+  low = 0;
+  range = 0xFFFFFFFFu;
+  code = 0;
+  for (int i=0; i < 4; i++)
+    code = (code << 8) | next();
+}
+
+unsigned char RangeDecoder::next(void)
+{
+  unsigned char c = pos < size ? data[pos] : 0;
+
+  pos++;
+  return c;
+}
+
+unsigned int RangeDecoder::frequency(unsigned int total)
+{
+  unsigned int f;
+
+  range /= total;
+  f = (code - low) / range;
+
+  return f < total ? f : total - 1;
+}
+
+void RangeDecoder::consume(unsigned int cum, unsigned int freq)
+{
+  low += cum * range;
+  range *= freq;
+  while ((low ^ (low + range)) < RC_TOP ||
+	 (range < RC_BOTTOM && ((range = -low & (RC_BOTTOM - 1)), 1)))
+  {
+    code = (code << 8) | next();
+    low <<= 8;
+    range <<= 8;
+  }
+}
+
+int RangeDecoder::decode(AdaptiveModel *model)
+{
+  unsigned int cum, freq;
+  int s;
+
+  s = model->find(frequency(model->total()), &cum, &freq);
+  consume(cum, freq);
+  model->update(s);
+
+  return s;
+}
+
+unsigned int RangeDecoder::decode_bits(int bits)
+{
+  unsigned int v, value = 0;
+
+  while (bits > 16)
+  {
+    bits -= 16;
+    v = frequency(1u << 16);
+    consume(v, 1);
+    value |= v << bits;
+  }
+  if (bits > 0)
+  {
+    v = frequency(1u << bits);
+    consume(v, 1);
+    value |= v;
+  }
+
+  return value;
+}
+
+unsigned int RangeDecoder::decode_number(AdaptiveModel *lengths)
+{
+  int bits = decode(lengths);
+
+  if (bits <= 1)
+    return bits;
+
+  return (1u << (bits - 1)) | decode_bits(bits - 1);
+}
+
+int RangeDecoder::position(void) const
+{
+  return pos;
+}
+
+int RangeDecoder::overrun(void) const
+{
+  return pos > size;
+}
+
+double max_adaptive_symbols(int symbols, int size)
+{
+  double bits = -log(1.0 - (symbols - 1) / (double) MODEL_LIMIT) / log(2.0);
+
+  if (symbols < 2)
+    return HUGE_VAL;
+  // the flushed state adds up to four bytes past the data
+  return 8.0 * (size + 4) / bits;
+}
+
+unsigned int zigzag(int value)
+{
+  return value < 0 ? 2u * (unsigned int) -(value + 1) + 1
+    : 2u * (unsigned int) value;
+}
+
+int unzigzag(unsigned int value)
+{
+  return (value & 1) ? -(int) (value >> 1) - 1 : (int) (value >> 1);
+}
+
+void put_uint32(vector<unsigned char> *out, unsigned int value)
+{
+  for (int i=0; i < 4; i++)
+    out->push_back((unsigned char) (value >> (8*i)));
+}
+
+void put_float(vector<unsigned char> *out, float value)
+{
+  unsigned int bits;
+
+  memcpy(&bits, &value, 4);
+  put_uint32(out, bits);
+}
+
+unsigned int get_uint32(const unsigned char *data)
+{
+  return data[0] | (data[1] << 8) | (data[2] << 16)
+    | ((unsigned int) data[3] << 24);
+}
+
+float get_float(const unsigned char *data)
+{
+  unsigned int bits = get_uint32(data);
+  float value;
+
+  memcpy(&value, &bits, 4);
+  return value;
+}
@@ -0,0 +1,105 @@
+//
+//    File: range_coder.h
+//
+//    Licensed under the terms of the Lesser General Public License.
+//
+
+#ifndef _RANGE_CODER_H
+#define _RANGE_CODER_H
+
+#include <vector>
+
+using namespace std;
+
+// Adaptive frequency model over the symbols 0 .. symbols-1. Counts
+// start at 1 and grow with every coded symbol; cumulative counts come
+// from a Fenwick tree, so large alphabets stay cheap. The total stays
+// below 2^16 as the coder requires, counts are halved when it would not.
+#define NUMBER_SYMBOLS 33
+
+class AdaptiveModel
+{
+public:
+  AdaptiveModel(int symbols);
+
+  int symbols(void) const;
+  unsigned int total(void) const;
+
+  // cumulative count below s and count of s
+  void interval(int s, unsigned int *cum, unsigned int *freq) const;
+  // the symbol whose interval holds target, with that interval
+  int find(unsigned int target, unsigned int *cum, unsigned int *freq) const;
+  void update(int s);
+
+private:
+  void rebuild(void);
+
+  vector<unsigned int> counts;
+  vector<unsigned int> tree;  // Fenwick tree of counts, 1-based
+  unsigned int sum;
+  int top_bit;                // largest power of two <= symbols
+};
+
+// Carry-less range coder (Subbotin) with 32-bit state; the bytes are
+// appended to a vector. Totals have to be below 2^16.
+class RangeEncoder
+{
+public:
+  RangeEncoder(vector<unsigned char> *out);
+
+  void encode(unsigned int cum, unsigned int freq, unsigned int total);
+  // adaptive symbol, the model is updated
+  void encode(int s, AdaptiveModel *model);
+  // value in 0 .. 2^bits-1 with equal probabilities
+  void encode_bits(unsigned int value, int bits);
+  // any value: its bit length through lengths (NUMBER_SYMBOLS symbols),
+  // then the bits below the leading one
+  void encode_number(unsigned int value, AdaptiveModel *lengths);
+  // flushes the state; the encoder must not be used afterwards
+  void finish(void);
+
+private:
+  unsigned int low, range;
+  vector<unsigned char> *out;
+};
+
+class RangeDecoder
+{
+public:
+  // reading past size gives zero bytes, see overrun()
+  RangeDecoder(const unsigned char *data, int size);
+
+  int decode(AdaptiveModel *model);
+  unsigned int decode_bits(int bits);
+  unsigned int decode_number(AdaptiveModel *lengths);
+  // bytes read so far, including the flushed state
+  int position(void) const;
+  int overrun(void) const;
+
+private:
+  unsigned int frequency(unsigned int total);
+  void consume(unsigned int cum, unsigned int freq);
+  unsigned char next(void);
+
+  unsigned int low, range, code;
+  const unsigned char *data;
+  int size, pos;
+};
+
+// most adaptive symbols of an alphabet of that size that size bytes can
+// hold: every other symbol keeps a count of at least 1 against a total
+// below MODEL_LIMIT, so each costs -log2(1 - (symbols-1)/2^16) bits or
+// more. Lets decoders reject header counts before allocating for them
+double max_adaptive_symbols(int symbols, int size);
+
+// zigzag mapping of signed differences onto encode_number() values
+unsigned int zigzag(int value);
+int unzigzag(unsigned int value);
+
+// little-endian fields of the binary headers
+void put_uint32(vector<unsigned char> *out, unsigned int value);
+void put_float(vector<unsigned char> *out, float value);
+unsigned int get_uint32(const unsigned char *data);
+float get_float(const unsigned char *data);
+
+#endif
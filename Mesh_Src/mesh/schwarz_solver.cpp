@@ -0,0 +1,229 @@
+//
+//    File: schwarz_solver.cpp
+//
+//    Licensed under the terms of the Lesser General Public License.
+//
+
+#include <algorithm>
+
+#include "schwarz_solver.h"
+
+SchwarzSolver::SchwarzSolver(int overlap)
+{
+  this->overlap = overlap;
+}
+
+SchwarzSolver::~SchwarzSolver()
+{
+  clear_blocks();
+}
+
+void SchwarzSolver::clear_blocks(void)
+{
+  for (int s=0; s < (int) blocks.size(); s++)
+    delete blocks[s];
+  blocks.clear();
+  block_matrices.clear();
+}
+
+void SchwarzSolver::set_gram(const SpMatR *gram)
+{
+  const int *outer, *inner;
+  int n = gram->rows();
+  int i, k;
+
+  clear_blocks();
+  matrix = gram->cast<double>();
+  // the weights go onto the diagonal, so every row needs its entry
+  for (i=0; i < n; i++)
+    matrix.coeffRef(i, i) += 0.0;
+  matrix.makeCompressed();
+
+  outer = matrix.outerIndexPtr();
+  inner = matrix.innerIndexPtr();
+  diagonal.resize(n);
+  gram_diagonal.resize(n);
+  for (i=0; i < n; i++)
+    for (k=outer[i]; k < outer[i+1]; k++)
+      if (inner[k] == i)
+      {
+	diagonal[i] = k;
+	gram_diagonal(i) = matrix.valuePtr()[k];
+      }
+  weight = VectorXd::Zero(n);
+}
+
+int SchwarzSolver::number_of_subdomains(void) const
+{
+  return subdomains.size();
+}
+
+void SchwarzSolver::set_partitions(const vector< vector<int> > &parts,
+				   const vector<int> &offset,
+				   const vector<int> &adjacency)
+{
+  int n = offset.size() - 1;
+  vector<char> member(n, 0);
+  int s, r, i, k, j, begin, end;
+
+  clear_blocks();
+  subdomains.assign(parts.size(), vector<int>());
+  for (s=0; s < (int) parts.size(); s++)
+  {
+    vector<int> &domain = subdomains[s];
+
+    domain = parts[s];
+    for (i=0; i < (int) domain.size(); i++)
+      member[domain[i]] = 1;
+    // one ring per round, breadth-first from the partition
+    for (r=0, begin=0; r < overlap; r++)
+    {
+      end = domain.size();
+      for (i=begin; i < end; i++)
+	for (k=offset[domain[i]]; k < offset[domain[i]+1]; k++)
+	{
+	  j = adjacency[k];
+	  if (!member[j])
+	  {
+	    member[j] = 1;
+	    domain.push_back(j);
+	  }
+	}
+      begin = end;
+    }
+    for (i=0; i < (int) domain.size(); i++)
+      member[domain[i]] = 0;
+    sort(domain.begin(), domain.end());
+  }
+}
+
+int SchwarzSolver::factorize(const VectorXd &weight)
+{
+  int n = matrix.rows(), count = subdomains.size(), failed = 0;
+  double *value = matrix.valuePtr();
+  vector<char> changed(n, 0);
+  vector<int> pending;
+  int i, s, k;
+
+  for (i=0; i < n; i++)
+    if (blocks.empty() || weight(i) != this->weight(i))
+    {
+      changed[i] = 1;
+      value[diagonal[i]] = gram_diagonal(i) + weight(i);
+    }
+  this->weight = weight;
+
+  if (blocks.empty())
+  {
+    block_matrices.assign(count, SpMatd());
+    blocks.assign(count, (Block_Solver*) NULL);
+  }
+  // only the subdomains that hold a changed weight
+  for (s=0; s < count; s++)
+    for (i=0; i < (int) subdomains[s].size(); i++)
+      if (changed[subdomains[s][i]])
+      {
+	pending.push_back(s);
+	break;
+      }
+
+#pragma omp parallel for schedule(dynamic) reduction(+:failed)
+  for (k=0; k < (int) pending.size(); k++)
+    failed += factorize_block(pending[k]);
+
+  return failed > 0;
+}
+
+// a new block is taken from M and analysed; a known one has the same
+// pattern, so its diagonal is refreshed and it is factored again
+int SchwarzSolver::factorize_block(int s)
+{
+  const vector<int> &domain = subdomains[s];
+  const int *outer = matrix.outerIndexPtr();
+  const int *inner = matrix.innerIndexPtr();
+  const double *value = matrix.valuePtr();
+  SpMatd &A = block_matrices[s];
+  int i, k;
+
+  if (blocks[s] == NULL)
+  {
+    vector< Triplet<double> > triplets;
+    vector<int>::const_iterator at;
+
+    // the rows and columns of M that belong to the subdomain
+    for (i=0; i < (int) domain.size(); i++)
+      for (k=outer[domain[i]]; k < outer[domain[i]+1]; k++)
+      {
+	at = lower_bound(domain.begin(), domain.end(), inner[k]);
+	if (at != domain.end() && *at == inner[k])
+	  triplets.push_back(Triplet<double>(i, at - domain.begin(),
+					     value[k]));
+      }
+    A.resize(domain.size(), domain.size());
+    A.setFromTriplets(triplets.begin(), triplets.end());
+
+    blocks[s] = new Block_Solver;
+    blocks[s]->analyzePattern(A);
+  }
+  else
+    for (i=0; i < (int) domain.size(); i++)
+      A.coeffRef(i, i) = value[diagonal[domain[i]]];
+
+  blocks[s]->factorize(A);
+
+  return blocks[s]->info() != Success;
+}
+
+// y = M x, rows in parallel
+void SchwarzSolver::multiply(const MatrixXd &x, MatrixXd *y) const
+{
+  const int *outer = matrix.outerIndexPtr();
+  const int *inner = matrix.innerIndexPtr();
+  const double *value = matrix.valuePtr();
+  int n = matrix.rows(), cols = x.cols();
+  int i;
+
+  y->resize(n, cols);
+#pragma omp parallel for
+  for (i=0; i < n; i++)
+    for (int c=0; c < cols; c++)
+    {
+      const double *xc = x.col(c).data();
+      double s = 0.0;
+
+      for (int k=outer[i]; k < outer[i+1]; k++)
+	s += value[k] * xc[inner[k]];
+      (*y)(i, c) = s;
+    }
+}
+
+// z = sum of the subdomain solves of r; the solves run in parallel,
+// the sum in subdomain order so the result does not depend on threads
+void SchwarzSolver::precondition(const MatrixXd &r, MatrixXd *z) const
+{
+  int count = subdomains.size(), cols = r.cols();
+  vector<MatrixXd> local(count);
+  int s, i;
+
+#pragma omp parallel for schedule(dynamic)
+  for (s=0; s < count; s++)
+  {
+    const vector<int> &domain = subdomains[s];
+    MatrixXd rs(domain.size(), cols);
+
+    for (int k=0; k < (int) domain.size(); k++)
+      rs.row(k) = r.row(domain[k]);
+    local[s] = blocks[s]->solve(rs);
+  }
+
+  z->setZero(r.rows(), cols);
+  for (s=0; s < count; s++)
+    for (i=0; i < (int) subdomains[s].size(); i++)
+      z->row(subdomains[s][i]) += local[s].row(i);
+}
+
+int SchwarzSolver::solve(const MatrixXd &b, MatrixXd *x, double tolerance,
+			 int max_iterations) const
+{
+  return pcg_solve(*this, b, x, tolerance, max_iterations);
+}
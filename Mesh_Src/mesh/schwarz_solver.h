@@ -0,0 +1,77 @@
+//
+//    File: schwarz_solver.h
+//
+//    Licensed under the terms of the Lesser General Public License.
+//
+
+#ifndef _SCHWARZ_SOLVER_H
+#define _SCHWARZ_SOLVER_H
+
+#include <vector>
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+
+#include "normal_solver.h"
+#include "pcg_solver.h"
+
+using namespace Eigen;
+using namespace std;
+
+typedef Eigen::SparseMatrix<float, RowMajor> SpMatR;
+
+// Domain-decomposed solver for the anchored normal equations
+// M x = (L^T L + diag(weight)) x = b. Every partition of the mesh is
+// grown by a few rings of neighbours into an overlapping subdomain,
+// whose block of M is factored with SimplicialLDLT. The blocks are
+// independent, so they are factored and solved in parallel. They
+// precondition conjugate gradients on the whole of M (additive
+// Schwarz), which couples the partitions through the overlaps. The
+// result is the solution of the global system to the given tolerance,
+// without seams between the partitions. The blocks are kept: a new
+// weight only refactors the subdomains whose diagonal changed.
+class SchwarzSolver : public PCGOperator
+{
+public:
+  SchwarzSolver(int overlap = 2);
+  ~SchwarzSolver();
+
+  // L^T L; drops the factored blocks
+  void set_gram(const SpMatR *gram);
+  // vertex numbers of each partition, every vertex in one of them;
+  // offset and adjacency are the mesh graph in CSR form, as
+  // Mesh::adjacency, on which the overlap grows
+  void set_partitions(const vector< vector<int> > &parts,
+		      const vector<int> &offset,
+		      const vector<int> &adjacency);
+  // nonzero if a subdomain block is singular
+  int factorize(const VectorXd &weight);
+  // pcg_solve() on M; returns the iterations, -1 if the residual of a
+  // column stays above tolerance*|b|
+  int solve(const MatrixXd &b, MatrixXd *x, double tolerance,
+	    int max_iterations) const;
+
+  int number_of_subdomains(void) const;
+
+  // y = M x and the sum of the subdomain solves
+  void multiply(const MatrixXd &x, MatrixXd *y) const;
+  void precondition(const MatrixXd &r, MatrixXd *z) const;
+
+private:
+  SchwarzSolver(const SchwarzSolver &s);
+  SchwarzSolver& operator=(const SchwarzSolver &s);
+  void clear_blocks(void);
+  int factorize_block(int s);
+
+  typedef SimplicialLDLT<SpMatd, Lower, AMDOrdering<int> > Block_Solver;
+
+  int overlap;
+  SparseMatrix<double, RowMajor> matrix;  // M
+  VectorXd gram_diagonal;                 // diagonal of L^T L
+  vector<int> diagonal;                   // M(i,i) in the values of M
+  VectorXd weight;                        // weight inside the blocks
+  vector< vector<int> > subdomains;       // sorted vertex numbers
+  vector<SpMatd> block_matrices;          // M on every subdomain
+  vector<Block_Solver*> blocks;
+};
+
+#endif
@@ -0,0 +1,402 @@
+//
+//    File: triangle_bvh.cpp
+//
+//    Licensed under the terms of the Lesser General Public License.
+//
+
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+
+#include "triangle_bvh.h"
+
+#define BVH_LEAF 4
+
+// orders triangle numbers by their centroid along one axis
+class Centroid_Less
+{
+public:
+  Centroid_Less(const float *centroids, int axis)
+    : centroids(centroids), axis(axis) {}
+  bool operator()(int i, int j) const
+    { return centroids[3*i+axis] < centroids[3*j+axis]; }
+
+private:
+  const float *centroids;
+  int axis;
+};
+
+// squared distance from p to the triangle a b c (Ericson, Real-Time
+// Collision Detection, 5.1.5), by the region of the closest point
+static double triangle_distance2(const float *p, const float *a,
+				 const float *b, const float *c)
+{
+  double ab[3], ac[3], ap[3], bp[3], cp[3], q[3];
+  double d1, d2, d3, d4, d5, d6, va, vb, vc, v, w, den;
+  int k;
+
+  for (k=0; k < 3; k++)
+  {
+    ab[k] = b[k] - a[k];
+    ac[k] = c[k] - a[k];
+    ap[k] = p[k] - a[k];
+    bp[k] = p[k] - b[k];
+    cp[k] = p[k] - c[k];
+  }
+  d1 = ab[0]*ap[0] + ab[1]*ap[1] + ab[2]*ap[2];
+  d2 = ac[0]*ap[0] + ac[1]*ap[1] + ac[2]*ap[2];
+  d3 = ab[0]*bp[0] + ab[1]*bp[1] + ab[2]*bp[2];
+  d4 = ac[0]*bp[0] + ac[1]*bp[1] + ac[2]*bp[2];
+  d5 = ab[0]*cp[0] + ab[1]*cp[1] + ab[2]*cp[2];
+  d6 = ac[0]*cp[0] + ac[1]*cp[1] + ac[2]*cp[2];
+  vc = d1*d4 - d3*d2;
+  vb = d5*d2 - d1*d6;
+  va = d3*d6 - d5*d4;
+
+  if (d1 <= 0 && d2 <= 0)
+    return ap[0]*ap[0] + ap[1]*ap[1] + ap[2]*ap[2];
+  if (d3 >= 0 && d4 <= d3)
+    return bp[0]*bp[0] + bp[1]*bp[1] + bp[2]*bp[2];
+  if (d6 >= 0 && d5 <= d6)
+    return cp[0]*cp[0] + cp[1]*cp[1] + cp[2]*cp[2];
+
+  if (vc <= 0 && d1 >= 0 && d3 <= 0)
+  {
+    // edge ab
+    v = d1 / (d1 - d3);
+    for (k=0; k < 3; k++)
+      q[k] = ap[k] - v * ab[k];
+  }
+  else if (vb <= 0 && d2 >= 0 && d6 <= 0)
+  {
+    // edge ac
+    w = d2 / (d2 - d6);
+    for (k=0; k < 3; k++)
+      q[k] = ap[k] - w * ac[k];
+  }
+  else if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0)
+  {
+    // edge bc
+    w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+    for (k=0; k < 3; k++)
+      q[k] = bp[k] - w * (c[k] - b[k]);
+  }
+  else
+  {
+    // inside the face; degenerate triangles ended in a region above
+    den = va + vb + vc;
+    if (den <= 0)
+      return ap[0]*ap[0] + ap[1]*ap[1] + ap[2]*ap[2];
+    v = vb / den;
+    w = vc / den;
+    for (k=0; k < 3; k++)
+      q[k] = ap[k] - v * ab[k] - w * ac[k];
+  }
+
+  return q[0]*q[0] + q[1]*q[1] + q[2]*q[2];
+}
+
+// squared distance from p to a box, 0 inside
+static double box_distance2(const float *p, const float *low,
+			    const float *high)
+{
+  double d, sum = 0;
+  int k;
+
+  for (k=0; k < 3; k++)
+  {
+    d = 0;
+    if (p[k] < low[k])
+      d = low[k] - p[k];
+    else if (p[k] > high[k])
+      d = p[k] - high[k];
+    sum += d * d;
+  }
+
+  return sum;
+}
+
+TriangleBVH::TriangleBVH(void)
+{
+}
+
+void TriangleBVH::clear(void)
+{
+  nodes.clear();
+  order.clear();
+  corners.clear();
+}
+
+int TriangleBVH::size(void) const
+{
+  return order.size();
+}
+
+void TriangleBVH::build(const MatrixXf &points, const vector<int> &indices)
+{
+  vector<float> centroids, unordered;
+  int i, j, k, n = indices.size() / 3;
+
+  clear();
+  if (n == 0)
+    return;
+
+  unordered.resize(9*n);
+  centroids.assign(3*n, 0);
+  for (i=0; i < n; i++)
+    for (j=0; j < 3; j++)
+      for (k=0; k < 3; k++)
+      {
+	unordered[9*i+3*j+k] = points(indices[3*i+j], k);
+	centroids[3*i+k] += unordered[9*i+3*j+k] / 3;
+      }
+
+  order.resize(n);
+  for (i=0; i < n; i++)
+    order[i] = i;
+  nodes.reserve(2*n / BVH_LEAF + 1);
+  nodes.resize(1);
+  corners.swap(unordered);
+  build(0, 0, n, centroids);
+
+  // corners in leaf order for the queries
+  unordered.resize(9*n);
+  for (i=0; i < n; i++)
+    for (k=0; k < 9; k++)
+      unordered[9*i+k] = corners[9*order[i]+k];
+  corners.swap(unordered);
+}
+
+void TriangleBVH::build(int node, int lo, int hi,
+			const vector<float> &centroids)
+{
+  float low[3], high[3], c_low[3], c_high[3];
+  int i, k, m, a, child;
+
+  // box of the corners, and of the centroids to choose the split
+  for (k=0; k < 3; k++)
+  {
+    low[k] = c_low[k] = FLT_MAX;
+    high[k] = c_high[k] = -FLT_MAX;
+  }
+  for (i=lo; i < hi; i++)
+    for (k=0; k < 3; k++)
+    {
+      low[k] = min(low[k], min(corners[9*order[i]+k],
+			       min(corners[9*order[i]+3+k],
+				   corners[9*order[i]+6+k])));
+      high[k] = max(high[k], max(corners[9*order[i]+k],
+				 max(corners[9*order[i]+3+k],
+				     corners[9*order[i]+6+k])));
+      c_low[k] = min(c_low[k], centroids[3*order[i]+k]);
+      c_high[k] = max(c_high[k], centroids[3*order[i]+k]);
+    }
+  for (k=0; k < 3; k++)
+  {
+    nodes[node].low[k] = low[k];
+    nodes[node].high[k] = high[k];
+  }
+
+  if (hi - lo <= BVH_LEAF)
+  {
+    nodes[node].first = lo;
+    nodes[node].count = hi - lo;
+    return;
+  }
+
+  a = 0;
+  for (k=1; k < 3; k++)
+    if (c_high[k] - c_low[k] > c_high[a] - c_low[a])
+      a = k;
+  m = (lo + hi) / 2;
+  nth_element(order.begin() + lo, order.begin() + m, order.begin() + hi,
+	      Centroid_Less(&centroids[0], a));
+
+  child = nodes.size();
+  nodes.resize(child + 2);
+  nodes[node].first = child;
+  nodes[node].count = 0;
+  build(child, lo, m, centroids);
+  build(child + 1, m, hi, centroids);
+}
+
+double TriangleBVH::distance(const float *p, int *triangle) const
+{
+  int stack[64];
+  int top, node, i, near_child, far_child, best_triangle;
+  double best, d, d_near, d_far;
+
+  if (nodes.empty())
+    return -1;
+
+  best = DBL_MAX;
+  best_triangle = -1;
+  top = 0;
+  stack[top++] = 0;
+  while (top > 0)
+  {
+    node = stack[--top];
+    if (box_distance2(p, nodes[node].low, nodes[node].high) >= best)
+      continue;
+
+    if (nodes[node].count > 0)
+    {
+      for (i=nodes[node].first;
+	   i < nodes[node].first + nodes[node].count; i++)
+      {
+	d = triangle_distance2(p, &corners[9*i], &corners[9*i+3],
+			       &corners[9*i+6]);
+	if (d < best)
+	{
+	  best = d;
+	  best_triangle = i;
+	}
+      }
+      continue;
+    }
+
+    // the nearer child goes on top to shrink best early
+    near_child = nodes[node].first;
+    far_child = near_child + 1;
+    d_near = box_distance2(p, nodes[near_child].low, nodes[near_child].high);
+    d_far = box_distance2(p, nodes[far_child].low, nodes[far_child].high);
+    if (d_far < d_near)
+    {
+      swap(near_child, far_child);
+      swap(d_near, d_far);
+    }
+    if (d_far < best)
+      stack[top++] = far_child;
+    if (d_near < best)
+      stack[top++] = near_child;
+  }
+
+  if (triangle != NULL)
+    *triangle = order[best_triangle];
+
+  return sqrt(best);
+}
+
+void TriangleBVH::distances(const MatrixXf &points, VectorXd *result) const
+{
+  int i, n = points.rows();
+
+  result->resize(n);
+#pragma omp parallel for schedule(dynamic, 256)
+  for (i=0; i < n; i++)
+  {
+    float p[3] = { points(i,0), points(i,1), points(i,2) };
+    (*result)(i) = distance(p);
+  }
+}
+
+// a small generator seeded per triangle, so sampling does not depend on
+// the order in which triangles are visited
+static unsigned int next_random(unsigned int *state)
+{
+  *state = *state * 1664525u + 1013904223u;
+  return *state;
+}
+
+static double triangle_area(const MatrixXf &points, const int *t)
+{
+  Vector3f ab, ac;
+
+  ab = points.row(t[1]).transpose() - points.row(t[0]).transpose();
+  ac = points.row(t[2]).transpose() - points.row(t[0]).transpose();
+
+  return 0.5 * ab.cross(ac).norm();
+}
+
+void sample_surface(const MatrixXf &points, const vector<int> &indices,
+		    int samples, MatrixXf *barycentric,
+		    vector<int> *triangles)
+{
+  vector<double> area;
+  vector<int> first;
+  double total = 0, sum = 0;
+  int i, n = indices.size() / 3;
+
+  triangles->clear();
+  area.resize(n);
+  for (i=0; i < n; i++)
+  {
+    area[i] = triangle_area(points, &indices[3*i]);
+    total += area[i];
+  }
+  if (samples <= 0 || total <= 0)
+  {
+    barycentric->resize(0, 2);
+    return;
+  }
+
+  // triangle i gets the samples between its cumulative area bounds
+  first.resize(n+1);
+  first[0] = 0;
+  for (i=0; i < n; i++)
+  {
+    sum += area[i];
+    first[i+1] = (int) floor(samples * (sum / total) + 0.5);
+  }
+  triangles->resize(first[n]);
+  barycentric->resize(first[n], 2);
+
+#pragma omp parallel for
+  for (i=0; i < n; i++)
+  {
+    unsigned int state = 2654435761u * (unsigned int) (i + 1);
+    float u, v;
+    int j;
+
+    for (j=first[i]; j < first[i+1]; j++)
+    {
+      // uniform on the triangle by folding the unit square
+      u = (next_random(&state) >> 8) / 16777216.0f;
+      v = (next_random(&state) >> 8) / 16777216.0f;
+      if (u + v > 1)
+      {
+	u = 1 - u;
+	v = 1 - v;
+      }
+      (*triangles)[j] = i;
+      (*barycentric)(j,0) = u;
+      (*barycentric)(j,1) = v;
+    }
+  }
+}
+
+void place_samples(const MatrixXf &points, const vector<int> &indices,
+		   const MatrixXf &barycentric, const vector<int> &triangles,
+		   MatrixXf *result)
+{
+  int i, m = triangles.size();
+
+  result->resize(m, 3);
+#pragma omp parallel for
+  for (i=0; i < m; i++)
+  {
+    const int *t = &indices[3*triangles[i]];
+    float u = barycentric(i,0), v = barycentric(i,1);
+    int k;
+
+    for (k=0; k < 3; k++)
+      (*result)(i,k) = (1 - u - v) * points(t[0],k)
+	+ u * points(t[1],k) + v * points(t[2],k);
+  }
+}
+
+void summarize_distances(const VectorXd &forward, const VectorXd &backward,
+			 Surface_Distance *result)
+{
+  int nf = forward.size(), nb = backward.size();
+
+  result->forward_max = nf > 0 ? forward.maxCoeff() : 0;
+  result->forward_mean = nf > 0 ? forward.mean() : 0;
+  result->forward_rms = nf > 0 ? sqrt(forward.squaredNorm() / nf) : 0;
+  result->backward_max = nb > 0 ? backward.maxCoeff() : 0;
+  result->backward_mean = nb > 0 ? backward.mean() : 0;
+  result->backward_rms = nb > 0 ? sqrt(backward.squaredNorm() / nb) : 0;
+  result->hausdorff = max(result->forward_max, result->backward_max);
+  result->rms = nf + nb > 0 ?
+    sqrt((forward.squaredNorm() + backward.squaredNorm()) / (nf + nb)) : 0;
+}
@@ -0,0 +1,75 @@
+//
+//    File: triangle_bvh.h
+//
+//    Licensed under the terms of the Lesser General Public License.
+//
+
+#ifndef _TRIANGLE_BVH_H
+#define _TRIANGLE_BVH_H
+
+#include <vector>
+#include <Eigen/Dense>
+
+using namespace Eigen;
+using namespace std;
+
+// Bounding volume hierarchy over a triangle surface given as points
+// (n x 3) and an index buffer of three point rows per triangle. Nodes
+// are axis-aligned boxes split at the median centroid of their longest
+// side; up to 4 triangles form a leaf. The tree keeps its own copy of
+// the corners, so it stays valid when the points change afterwards.
+// Queries are const and may run in parallel.
+class TriangleBVH
+{
+public:
+  TriangleBVH(void);
+
+  void build(const MatrixXf &points, const vector<int> &indices);
+  void clear(void);
+  int size(void) const;
+
+  // exact distance from p to the surface, -1 for an empty tree;
+  // triangle gets the number of the closest triangle
+  double distance(const float *p, int *triangle = NULL) const;
+  // distance of each row of points (m x 3), answered in parallel
+  void distances(const MatrixXf &points, VectorXd *result) const;
+
+private:
+  typedef struct
+  {
+    float low[3], high[3];
+    int first, count;   // leaf triangles; count 0: children first, first+1
+  } Node;
+
+  void build(int node, int lo, int hi, const vector<float> &centroids);
+
+  vector<Node> nodes;
+  vector<int> order;      // triangle numbers, leaves refer to ranges
+  vector<float> corners;  // 9 coordinates per triangle, in order
+};
+
+// area-weighted points on a surface: about samples points overall, as
+// barycentric coordinates (two per row, m x 2) with the triangle number
+// of each row; the same triangle gets the same points on every call
+void sample_surface(const MatrixXf &points, const vector<int> &indices,
+		    int samples, MatrixXf *barycentric,
+		    vector<int> *triangles);
+// the sampled points placed on the triangles of a surface
+void place_samples(const MatrixXf &points, const vector<int> &indices,
+		   const MatrixXf &barycentric, const vector<int> &triangles,
+		   MatrixXf *result);
+
+// distances between two surfaces: forward from the points of the first
+// to the second surface, backward the other way round
+typedef struct
+{
+  double forward_max, forward_mean, forward_rms;
+  double backward_max, backward_mean, backward_rms;
+  double hausdorff;   // larger of the two maxima
+  double rms;         // over the queries of both directions
+} Surface_Distance;
+
+void summarize_distances(const VectorXd &forward, const VectorXd &backward,
+			 Surface_Distance *result);
+
+#endif
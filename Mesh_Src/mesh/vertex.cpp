@@ -11,14 +11,14 @@
 Vertex::Vertex()
 { 
   data.set_zero(); 
-  normal=NULL; 
+  has_normal=0; 
   nr_edg=nr_tri=0; 
 }
 
 Vertex::Vertex(const Vertex &v)
 { 
   data=v.data; 
-  normal=NULL; 
+  has_normal=0; 
   nr_edg=nr_tri=0; 
 }
 
@@ -27,7 +27,7 @@ Vertex::Vertex(float x, float y, float z)
   data.v[0]=x; 
   data.v[1]=y; 
   data.v[2]=z; 
-  normal=NULL; 
+  has_normal=0; 
   nr_edg=nr_tri=0;
   dye = -1;
   to_anthor_length = 99999;
@@ -37,7 +37,6 @@ Vertex::Vertex(float x, float y, float z)
 
 Vertex::~Vertex()
 {
-  delete normal;
 }
 
 const float* Vertex::float_data(void) const
@@ -87,16 +86,19 @@ float Vertex::z(void) const
 
 const float* Vertex::float_normal(void) const
 {
-  return normal != NULL ? normal->v : NULL;
+  return has_normal ? normal.v : NULL;
 }
 
 void Vertex::add_normal(const MathVector *norm)
 {
-  if (normal == NULL)
-    normal = new MathVector();
+  if (!has_normal)
+    {
+      normal.set_zero();
+      has_normal=1;
+    }
 
-  normal->add(norm);
-  normal->normalize();
+  normal.add(norm);
+  normal.normalize();
 }
 
 void Vertex::rotate(const Matrix3<float> *r)
@@ -214,7 +216,7 @@ void Vertex::get_neighborvertexs(void)
 
 	for (it=neighborsedges->begin(); it != neighborsedges->end(); it++)
 	{
-		if ((*it)->vertices[0]->equal(this))
+		if ((*it)->vertices[0] == this)
 		{
 			neighborvertex.push_back( (*it)->vertices[1]);
 		}
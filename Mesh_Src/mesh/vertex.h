@@ -77,8 +77,6 @@ public:
   int dye;//dye==-1ʾδɫ
   float curvature;
   float square_devaition_angle;
-  double Sq;
-  double Mq;
   //xbb
   list<Vertex*> neighborvertex;//ڽӵ
   list<Vertex*> segmented_neighborvertex;//ָ֮󶥵ڽӵ
@@ -88,8 +86,8 @@ public:
   MathVector lapcoor;//laplacian ֵ
 
 private:
-  MathVector *normal, data;
-  int nr_tri, nr_edg;
+  MathVector normal, data;
+  int has_normal, nr_tri, nr_edg;
   list<Edge*> edges;
   list<Triangle*> triangles;
 };
@@ -0,0 +1,273 @@
+//
+//    File: vertex_order.cpp
+//
+//    Licensed under the terms of the Lesser General Public License.
+//
+
+#include <algorithm>
+#include <utility>
+#include <stdlib.h>
+
+#include "vertex_order.h"
+
+#define MORTON_BITS 10
+
+#define CACHE_SETS 64
+#define CACHE_WAYS 8
+#define CACHE_LINE_FLOATS 16
+
+static int degree(const vector<int> &offset, int i)
+{
+  return offset[i+1] - offset[i];
+}
+
+// breadth-first search from root over the unvisited vertices; appends
+// them to order and returns the level of the last one. level must be -1
+// for the vertices of the component
+static int level_structure(const vector<int> &offset,
+			   const vector<int> &adjacency, int root,
+			   vector<int> *level, vector<int> *order)
+{
+  int head = order->size(), i, k, j;
+
+  (*level)[root] = 0;
+  order->push_back(root);
+  while (head < (int) order->size())
+  {
+    i = (*order)[head++];
+    for (k=offset[i]; k < offset[i+1]; k++)
+    {
+      j = adjacency[k];
+      if ((*level)[j] < 0)
+      {
+	(*level)[j] = (*level)[i] + 1;
+	order->push_back(j);
+      }
+    }
+  }
+
+  return (*level)[order->back()];
+}
+
+void breadth_first_order(const vector<int> &offset,
+			 const vector<int> &adjacency, vector<int> *order)
+{
+  int n = offset.size() - 1;
+  vector<int> level(n, -1);
+
+  order->clear();
+  order->reserve(n);
+  for (int i=0; i < n; i++)
+    if (level[i] < 0)
+      level_structure(offset, adjacency, i, &level, order);
+}
+
+// George and Liu: start again from a vertex of smallest degree on the
+// last level until the depth stops growing
+static int pseudo_peripheral(const vector<int> &offset,
+			     const vector<int> &adjacency, int root,
+			     vector<int> *level)
+{
+  vector<int> component;
+  int depth, next_depth, i, k, best;
+
+  depth = level_structure(offset, adjacency, root, level, &component);
+  for (;;)
+  {
+    best = -1;
+    for (k=component.size()-1; k >= 0 && (*level)[component[k]] == depth;
+	 k--)
+      if (best < 0 || degree(offset, component[k]) <= degree(offset, best))
+	best = component[k];
+    for (i=0; i < (int) component.size(); i++)
+      (*level)[component[i]] = -1;
+    if (best == root)
+      return root;
+
+    component.clear();
+    next_depth = level_structure(offset, adjacency, best, level, &component);
+    if (next_depth <= depth)
+    {
+      for (i=0; i < (int) component.size(); i++)
+	(*level)[component[i]] = -1;
+      return root;
+    }
+    root = best;
+    depth = next_depth;
+  }
+}
+
+void cuthill_mckee_order(const vector<int> &offset,
+			 const vector<int> &adjacency, vector<int> *order)
+{
+  int n = offset.size() - 1;
+  vector<int> level(n, -1);
+  vector<char> visited(n, 0);
+  vector< pair<int, int> > next;
+  int i, k, j, head, root;
+
+  order->clear();
+  order->reserve(n);
+  for (root=0; root < n; root++)
+  {
+    if (visited[root])
+      continue;
+
+    head = order->size();
+    i = pseudo_peripheral(offset, adjacency, root, &level);
+    visited[i] = 1;
+    order->push_back(i);
+    while (head < (int) order->size())
+    {
+      i = (*order)[head++];
+      next.clear();
+      for (k=offset[i]; k < offset[i+1]; k++)
+      {
+	j = adjacency[k];
+	if (!visited[j])
+	{
+	  visited[j] = 1;
+	  next.push_back(make_pair(degree(offset, j), j));
+	}
+      }
+      sort(next.begin(), next.end());
+      for (k=0; k < (int) next.size(); k++)
+	order->push_back(next[k].second);
+    }
+  }
+
+  reverse(order->begin(), order->end());
+}
+
+// the bits of v spread to every third bit
+static unsigned int spread_bits(unsigned int v)
+{
+  v = (v | (v << 16)) & 0x030000FF;
+  v = (v | (v << 8)) & 0x0300F00F;
+  v = (v | (v << 4)) & 0x030C30C3;
+  v = (v | (v << 2)) & 0x09249249;
+
+  return v;
+}
+
+void morton_order(const MatrixXf &points, vector<int> *order)
+{
+  int n = points.rows(), i, c;
+  vector< pair<unsigned int, int> > keys(n);
+  float low[3], scale[3];
+  unsigned int key, cell;
+
+  for (c=0; c < 3; c++)
+  {
+    low[c] = n > 0 ? points.col(c).minCoeff() : 0.0;
+    scale[c] = n > 0 ? points.col(c).maxCoeff() - low[c] : 0.0;
+    scale[c] = scale[c] > 0.0 ? ((1 << MORTON_BITS) - 1) / scale[c] : 0.0;
+  }
+  for (i=0; i < n; i++)
+  {
+    key = 0;
+    for (c=0; c < 3; c++)
+    {
+      cell = (unsigned int) ((points(i,c) - low[c]) * scale[c]);
+      key |= spread_bits(min(cell, (1u << MORTON_BITS) - 1)) << c;
+    }
+    keys[i] = make_pair(key, i);
+  }
+  sort(keys.begin(), keys.end());
+
+  order->resize(n);
+  for (i=0; i < n; i++)
+    (*order)[i] = keys[i].second;
+}
+
+void vertex_order(Vertex_Order type, const vector<int> &offset,
+		  const vector<int> &adjacency, const MatrixXf &points,
+		  vector<int> *order)
+{
+  int i;
+
+  switch (type)
+  {
+  case BFS_ORDER:
+    breadth_first_order(offset, adjacency, order);
+    break;
+  case RCM_ORDER:
+    cuthill_mckee_order(offset, adjacency, order);
+    break;
+  case MORTON_ORDER:
+    morton_order(points, order);
+    break;
+  default:
+    order->resize(offset.size() - 1);
+    for (i=0; i < (int) order->size(); i++)
+      (*order)[i] = i;
+  }
+}
+
+const char* vertex_order_name(Vertex_Order type)
+{
+  switch (type)
+  {
+  case BFS_ORDER:
+    return "BFS";
+  case RCM_ORDER:
+    return "RCM";
+  case MORTON_ORDER:
+    return "Morton";
+  default:
+    return "file";
+  }
+}
+
+void order_locality(const vector<int> &offset, const vector<int> &adjacency,
+		    Order_Locality *locality)
+{
+  int n = offset.size() - 1, i, k, d, low;
+  int tags[CACHE_SETS][CACHE_WAYS], used[CACHE_SETS][CACHE_WAYS];
+  int line, set, way, oldest, clock = 0;
+  double distance = 0.0, profile = 0.0, accesses = 0.0, misses = 0.0;
+
+  for (set=0; set < CACHE_SETS; set++)
+    for (way=0; way < CACHE_WAYS; way++)
+    {
+      tags[set][way] = -1;
+      used[set][way] = 0;
+    }
+
+  locality->bandwidth = 0;
+  for (i=0; i < n; i++)
+  {
+    low = i;
+    // x[i] and then its neighbours, as laplacian_transpose_product()
+    for (k=offset[i]-1; k < offset[i+1]; k++)
+    {
+      line = (k < offset[i] ? i : adjacency[k]) / CACHE_LINE_FLOATS;
+      set = line % CACHE_SETS;
+      oldest = 0;
+      for (way=0; way < CACHE_WAYS && tags[set][way] != line; way++)
+	if (used[set][way] < used[set][oldest])
+	  oldest = way;
+      if (way == CACHE_WAYS)
+      {
+	misses++;
+	way = oldest;
+	tags[set][way] = line;
+      }
+      used[set][way] = ++clock;
+      accesses++;
+
+      if (k < offset[i])
+	continue;
+      d = abs(adjacency[k] - i);
+      locality->bandwidth = max(locality->bandwidth, d);
+      distance += d;
+      low = min(low, adjacency[k]);
+    }
+    profile += i - low;
+  }
+
+  locality->mean_distance = adjacency.empty() ? 0.0
+    : distance / adjacency.size();
+  locality->mean_profile = n > 0 ? profile / n : 0.0;
+  locality->miss_rate = accesses > 0.0 ? misses / accesses : 0.0;
+}
@@ -11,6 +11,56 @@ void dummy2(int size)
 {
 }
 
+// normal equation backends on the meshes under documents
+void benchmark_documents(void)
+{
+	const char *models[3] = {"documents\\wolf2534.ply", "documents\\horse4243BFS10.ply",
+		"documents\\Armadilloascii18245.ply"};
+	FILE *f, *out, *orders, *coder;
+
+	if ((out = fopen("documents\\solver benchmark.txt","w")) == NULL)
+		return;
+	if ((orders = fopen("documents\\ordering benchmark.txt","w")) == NULL)
+	{
+		fclose(out);
+		return;
+	}
+	if ((coder = fopen("documents\\connectivity check.txt","w")) == NULL)
+	{
+		fclose(orders);
+		fclose(out);
+		return;
+	}
+	fprintf(out, "model backend vertices anchors analyze(ms) factorize(ms) solve(ms) factor_memory(MB) peak_memory(MB) residual\n");
+	fprintf(coder, "model triangles bytes round_trip garbage_accepted\n");
+	fprintf(orders, "model order bandwidth mean_distance mean_profile miss_rate gram(ms) analyze(ms) factorize(ms) solve(ms) 100_products(ms)\n");
+	for (int i=0; i < 3; i++)
+	{
+		if ((f = fopen(models[i],"rb")) == NULL)
+			continue;
+		PLY_Mesh *mesh = new PLY_Mesh();
+		mesh->read(f, (int (*)(int)) dummy1, (void (*)(int)) dummy2);
+		fclose(f);
+		mesh->create_edges();
+		mesh->check_connectivity_coder(coder, models[i]);
+		mesh->move_to_centre();
+		mesh->scale_into_normal_sphere();
+		mesh->ini_ner_ver();
+		mesh->quantizing_laplacian_coordinates(8);
+		mesh->initialize_tripletList_and_deltamesh();
+		mesh->BFS_Graph(mesh->first_anchor, 10);
+		for (list<Vertex*>::iterator iv=mesh->get_vertices()->begin(); iv != mesh->get_vertices()->end(); iv++)
+			if ((*iv)->to_anthor_length == 0)
+				mesh->vesq.push_back(*iv);
+		mesh->benchmark_solvers(out, models[i]);
+		mesh->benchmark_orderings(orders, models[i]);
+		delete mesh;
+	}
+	fclose(coder);
+	fclose(orders);
+	fclose(out);
+}
+
 int main(int argc, char **argv)
 {
 	GLMesh_Settings settings;
@@ -37,7 +87,7 @@ int main(int argc, char **argv)
 		for (int j=0; j < 4; j++)
 			settings.tb_transform[i][j]= i == j ? 1.0 : 0.0;
 
-	if ((f = fopen("model\\happy16268.ply","r")) == NULL)	//Armadilloascii18245  horse4243 Laurana6301 D20000risu_noise fandisk skull blade10793 male10042 raptor7445 cow2903 bun_zipper17446 bun_zipper8747 blade5350
+	if ((f = fopen("model\\happy16268.ply","rb")) == NULL)	//Armadilloascii18245  horse4243 Laurana6301 D20000risu_noise fandisk skull blade10793 male10042 raptor7445 cow2903 bun_zipper17446 bun_zipper8747 blade5350
 	{
 		fprintf(stderr, "Can't open %s for reading\n", argv[1]);
 		exit(0);
@@ -89,9 +139,11 @@ int main(int argc, char **argv)
 	//	settings.mesh->test_anchor(bit,fs,s1);
 	//	s1 = ss;
 	//}
+	//settings.mesh->test_anchor_sweep(3,8,fs,ss);	//one factorization per anchor set for all bits
 	//fs.close();
 	//....................................................
 	settings.mesh->test_anchor3();
+	//benchmark_documents();
 	//....................................................................................
 	//argv[1] = "documents\\horse4243b1.ply";
 	//argv[2] = "documents\\horse4243b2.ply";